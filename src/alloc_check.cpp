@@ -0,0 +1,152 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file alloc_check.cpp
+   \brief check for heap allocations in code that should not make any
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "alloc_check.hpp"
+
+#include <cerrno>
+#include <cstddef>
+
+namespace {
+// thread local without a constructor, so safe to use inside malloc
+__thread bool armed = false;
+__thread uint64_t count = 0;
+}; // namespace
+
+extern "C" __attribute__((noinline)) void alloc_check_violation()
+{
+  // keep the call, for setting a breakpoint
+  asm volatile("");
+}
+
+void AllocCheck::arm()
+{
+  count = 0;
+  armed = true;
+}
+
+uint64_t AllocCheck::disarm()
+{
+  armed = false;
+  return count;
+}
+
+AllocCheck::Pause::Pause(bool active) : was_armed(armed)
+{
+  if (active)
+    armed = false;
+}
+
+AllocCheck::Pause::~Pause() { armed = was_armed; }
+
+#if ALLOC_CHECK
+
+bool AllocCheck::is_enabled() { return true; }
+
+// Interpose the glibc heap functions, counting allocations while armed
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t num, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void *__libc_valloc(size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace {
+inline void count_alloc()
+{
+  if (armed) {
+    count++;
+    alloc_check_violation();
+  }
+}
+}; // namespace
+
+extern "C" {
+void *malloc(size_t size)
+{
+  count_alloc();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size)
+{
+  count_alloc();
+  return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+  count_alloc();
+  return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+  count_alloc();
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+  count_alloc();
+  return __libc_memalign(alignment, size);
+}
+
+void *valloc(size_t size)
+{
+  count_alloc();
+  return __libc_valloc(size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  count_alloc();
+  if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)))
+    return EINVAL;
+  void *mem = __libc_memalign(alignment, size);
+  if (!mem)
+    return ENOMEM;
+  *ptr = mem;
+  return 0;
+}
+
+// buffers allocated before the check may be freed after it, while the
+// check is still armed, so only allocations are counted
+void free(void *ptr) { __libc_free(ptr); }
+} // extern "C"
+
+#else // !ALLOC_CHECK
+
+bool AllocCheck::is_enabled() { return false; }
+
+#endif // ALLOC_CHECK
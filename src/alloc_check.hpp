@@ -0,0 +1,70 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file alloc_check.hpp
+   \brief check for heap allocations in code that should not make any
+*/
+
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+#include <cstdint>
+
+/// Count heap allocations made by a thread
+/** Only counts in a build configured with \c --enable-alloc-check, which
+ *  interposes the heap functions, otherwise the count is always \c 0. To
+ *  find where an allocation is made, break on \c alloc_check_violation()
+ *  in a debugger. */
+class AllocCheck {
+public:
+  /// Start counting allocations on this thread
+  static void arm();
+
+  /// Stop counting allocations on this thread
+  /**\return The number of allocations since arm(). */
+  static uint64_t disarm();
+
+  /// Whether allocations are counted in this build
+  /**\return \c true if allocations are counted. */
+  static bool is_enabled();
+
+  /// Stop counting while in scope, for code that is allowed to allocate
+  class Pause {
+  private:
+    bool was_armed;
+
+  public:
+    /// Constructor
+    /**\param active whether to stop counting. */
+    Pause(bool active = true);
+    ~Pause();
+    Pause(const Pause &) = delete;
+    Pause &operator=(const Pause &) = delete;
+  };
+};
+
+/// Called for each counted allocation
+extern "C" void alloc_check_violation();
+
+#endif // ALLOC_CHECK_H
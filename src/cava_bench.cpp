@@ -0,0 +1,351 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file cava_bench.cpp
+   \brief benchmarks of cava plans, for measuring optimisations
+*/
+
+#include "cava_plan.hpp"
+#include "plan_memory.hpp"
+#include "programopts.hpp"
+#include "spectrum_generator.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+
+class CavaBench : public ProgramOpts {
+private:
+  std::string test;
+  int bars = 30;
+  int rate = 44100;
+  int channels = 2;
+  double noise_reduction = 0.77;
+  double framerate = 100;
+  double seconds = 60;
+  int num_plans = 64;
+  int repeats = 3;
+
+  CavaPlanParams get_plan_params() const;
+  Status run_denormal();
+  Status run_fixed();
+  Status run_plans();
+
+public:
+  CavaBench() : ProgramOpts("cava_bench") {}
+  void process_command_line(int argc, char **argv);
+  void usage();
+  Status run();
+};
+
+void CavaBench::usage()
+{
+  fprintf(stdout, R"(
+Usage: %s [options] test
+
+Time cava processing of a test signal, to measure optimisations. The
+signal is the same on every run. test is one of
+
+  denormal   executions of a plan on the signal, and then on silence, with
+             the number of smoothing values in the denormal range
+  fixed      a SpectrumGenerator in floating point with the exact framerate
+             (cava_filter -E), and in fixed point (cava_filter -X)
+  plans      several plans executed in turn, with the buffers allocated by
+             malloc, and by PlanMemory (cava_filter -H)
+
+Times are CPU times of the test thread, the fastest of any repeats, in
+microseconds for each execution, or seconds for all of the signal.
+
+  Options
+%s
+  -b <num>   number of bars per channel (default: 30)
+  -R <hz>    sample rate (default: 44100)
+  -C <cnls>  channels, 1 or 2 (default: 2)
+  -n <fact>  noise reduction (default: 0.77)
+  -f <hz>    executions per second, or frames per second for fixed
+             (default: 100)
+  -s <secs>  seconds of signal (default: 60)
+  -N <num>   number of plans, for plans (default: 64)
+  -r <num>   number of repeats (default: 3)
+
+  )",
+          get_program_name().c_str(), help_ver_text);
+}
+
+void CavaBench::process_command_line(int argc, char **argv)
+{
+  opterr = 0;
+  int c;
+
+  handle_long_opts(argc, argv);
+
+  while ((c = getopt(argc, argv, ":hb:R:C:n:f:s:N:r:")) != -1) {
+    if (common_opts(c, optopt))
+      continue;
+
+    switch (c) {
+    case 'b':
+      print_status_or_exit(read_int(optarg, &bars), c);
+      break;
+
+    case 'R':
+      print_status_or_exit(read_int(optarg, &rate), c);
+      break;
+
+    case 'C':
+      print_status_or_exit(read_int(optarg, &channels), c);
+      if (channels < 1 || channels > 2)
+        error("channels must be 1 or 2", c);
+      break;
+
+    case 'n':
+      print_status_or_exit(read_double(optarg, &noise_reduction), c);
+      break;
+
+    case 'f':
+      print_status_or_exit(read_double(optarg, &framerate), c);
+      if (framerate <= 0)
+        error("rate must be greater than 0", c);
+      break;
+
+    case 's':
+      print_status_or_exit(read_double(optarg, &seconds), c);
+      if (seconds <= 0)
+        error("seconds must be greater than 0", c);
+      break;
+
+    case 'N':
+      print_status_or_exit(read_int(optarg, &num_plans), c);
+      if (num_plans < 1)
+        error("number of plans must be greater than 0", c);
+      break;
+
+    case 'r':
+      print_status_or_exit(read_int(optarg, &repeats), c);
+      if (repeats < 1)
+        error("number of repeats must be greater than 0", c);
+      break;
+
+    default:
+      error("unknown command line error");
+    }
+  }
+
+  if (argc - optind != 1)
+    error("a test must be given");
+  test = argv[optind];
+  print_status_or_exit(get_plan_params().check());
+}
+
+namespace {
+// CPU time of this thread, so time when the thread is not running, on a
+// busy machine, is not counted
+struct Clock {
+  typedef double time_point;
+  static time_point now()
+  {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+  }
+};
+
+double seconds_since(Clock::time_point start) { return Clock::now() - start; }
+
+// a test signal of notes and noise, the same on every run
+std::vector<int16_t> make_signal(int rate, int channels, double seconds)
+{
+  uint32_t random = 12345;
+  const size_t num_frames = rate * seconds;
+  const size_t note_len = rate / 4;
+  std::vector<int16_t> samples(num_frames * channels);
+  double freq = 110.0;
+  for (size_t i = 0; i < num_frames; i++) {
+    if (i % note_len == 0) {
+      random = random * 1664525u + 1013904223u;
+      freq = 110.0 * pow(2.0, (random >> 24) % 36 / 12.0);
+    }
+    const double t = (double)i / rate;
+    const double env = exp(-3.0 * (i % note_len) / rate);
+    for (int c = 0; c < channels; c++) {
+      random = random * 1664525u + 1013904223u;
+      double val = 0.01 * ((random >> 8) / (double)(1u << 23) - 1);
+      for (int h = 1; h <= 4; h++)
+        val += env / h * sin(2 * M_PI * freq * h * t + c);
+      samples[i * channels + c] = lround(0.3 * INT16_MAX * val);
+    }
+  }
+  return samples;
+}
+
+// the anonymous memory in huge pages of this process, in KiB
+long get_huge_page_kib()
+{
+  FILE *file = fopen("/proc/self/smaps_rollup", "r");
+  if (!file)
+    return -1;
+  char line[256];
+  long kib = -1;
+  while (fgets(line, sizeof(line), file))
+    if (sscanf(line, "AnonHugePages: %ld", &kib) == 1)
+      break;
+  fclose(file);
+  return kib;
+}
+}; // namespace
+
+CavaPlanParams CavaBench::get_plan_params() const
+{
+  return {bars, rate, channels, 0, noise_reduction, 50,
+          std::min(10000, rate / 2)};
+}
+
+Status CavaBench::run_denormal()
+{
+  CavaPlan plan;
+  Status stat = plan.init(get_plan_params());
+  if (!stat)
+    return stat;
+
+  const int exec_len = lround(rate / framerate) * channels;
+  const auto signal = make_signal(rate, channels, seconds);
+  std::vector<double> in(signal.begin(), signal.end());
+  std::vector<double> silence(exec_len, 0.0);
+  std::vector<double> out(plan.get_bars_total());
+  const int bars_total = plan.get_bars_total();
+
+  const size_t signal_execs = in.size() / exec_len;
+  auto start = Clock::now();
+  for (size_t i = 0; i < signal_execs; i++)
+    plan.execute(in.data() + i * exec_len, exec_len, out.data());
+  printf("signal:  %8.2f us/exec\n", 1e6 * seconds_since(start) / signal_execs);
+
+  // the smoothing decays during silence, at the rate of the noise reduction
+  const int block_execs = 10000;
+  for (int block = 0; block < 10; block++) {
+    start = Clock::now();
+    for (int i = 0; i < block_execs; i++)
+      plan.execute(silence.data(), exec_len, out.data());
+    const double us = 1e6 * seconds_since(start) / block_execs;
+    int denormals = 0;
+    for (int i = 0; i < bars_total; i++)
+      denormals += std::fpclassify(plan.get()->cava_mem[i]) == FP_SUBNORMAL;
+    printf("silence: %8.2f us/exec after %6d execs, denormal values %d/%d\n",
+           us, (block + 1) * block_execs, denormals, bars_total);
+  }
+
+  return Status::ok();
+}
+
+Status CavaBench::run_fixed()
+{
+  const auto signal = make_signal(rate, channels, seconds);
+  const char *names[] = {"float -E", "fixed -X"};
+  double times[2];
+  for (int fixed = 0; fixed < 2; fixed++) {
+    times[fixed] = 1e30;
+    for (int rep = 0; rep < repeats; rep++) {
+      SpectrumGenerator generator;
+      Status stat = generator.init(get_plan_params(), framerate);
+      if (stat && fixed)
+        stat = generator.set_fixed_point(true);
+      if (!stat)
+        return stat;
+      if (!fixed)
+        generator.set_exact_framerate(true);
+
+      auto start = Clock::now();
+      generator.push(signal.data(), signal.size());
+      times[fixed] = std::min(times[fixed], seconds_since(start));
+    }
+    printf("%s: %8.4f s\n", names[fixed], times[fixed]);
+  }
+  printf("fixed / float: %.2f\n", times[1] / times[0]);
+
+  return Status::ok();
+}
+
+Status CavaBench::run_plans()
+{
+  const int exec_len = lround(rate / framerate) * channels;
+  const auto signal = make_signal(rate, channels, seconds);
+  std::vector<double> in(signal.begin(), signal.end());
+  const size_t num_execs = in.size() / exec_len;
+
+  const char *names[] = {"malloc", "PlanMemory"};
+  for (int huge = 0; huge < 2; huge++) {
+    const long kib_before = get_huge_page_kib();
+    if (huge)
+      PlanMemory::use_in_thread();
+    std::vector<CavaPlan> plans(num_plans);
+    for (auto &plan : plans) {
+      Status stat = plan.init(get_plan_params());
+      if (!stat)
+        return stat;
+    }
+    cava_set_allocator(nullptr, nullptr);
+    const long kib_after = get_huge_page_kib();
+    std::vector<double> out(plans[0].get_bars_total());
+
+    // each plan executes the signal, one execution of each plan in turn
+    double best = 1e30;
+    for (int rep = 0; rep < repeats; rep++) {
+      for (auto &plan : plans)
+        plan.reset_state();
+      auto start = Clock::now();
+      for (size_t i = 0; i < num_execs; i++)
+        for (auto &plan : plans)
+          plan.execute(in.data() + i * exec_len, exec_len, out.data());
+      best = std::min(best, seconds_since(start));
+    }
+    printf("%-10s: %8.2f us/exec, huge pages %ld KiB\n", names[huge],
+           1e6 * best / (num_execs * num_plans), kib_after - kib_before);
+  }
+
+  return Status::ok();
+}
+
+Status CavaBench::run()
+{
+  if (test == "denormal")
+    return run_denormal();
+  if (test == "fixed")
+    return run_fixed();
+  if (test == "plans")
+    return run_plans();
+  return Status::error("unknown test '" + test + "'");
+}
+
+int main(int argc, char *argv[])
+{
+  CavaBench bench;
+  bench.process_command_line(argc, argv);
+  bench.print_status_or_exit(bench.run());
+
+  return 0;
+}
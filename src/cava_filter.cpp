@@ -22,22 +22,43 @@
   IN THE SOFTWARE.
 */
 
+#include "alloc_check.hpp"
+#include "cava_server.hpp"
+#include "cava_socket.hpp"
+#include "checkpoint.hpp"
+#include "decimator.hpp"
+#include "frame_index.hpp"
+#include "loudness.hpp"
 #include "programopts.hpp"
+#include "result_cache.hpp"
+#include "spectrum_generator.hpp"
+#include "spectrum_pyramid.hpp"
+#include "uring_io.hpp"
 #include "utils.hpp"
 
-extern "C" {
-#include "cavacore/cavacore.h"
-}
-
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <sched.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
 
 class CavaFilter : public ProgramOpts {
 private:
-  const size_t input_len_per_channel = 4096;
+  // samples read from the input at once (1 MiB), independent of the
+  // execution and frame sizes
+  const size_t input_block_len = 1 << 19;
+  // samples read at once from a pipe or socket, where a read waits for a
+  // full block, so kept small for low latency
+  const size_t stream_block_len = 1 << 13;
 
   // input audio format must be pcm_s16le, convert with, e.g.
   // ffmpeg -i file.wav -f s16le -ar 44100 -acodec pcm_s16le -ac 2
@@ -46,23 +67,88 @@ private:
 
   int bars_per_channel = 10;
   int channels_out = 1;
+  bool downmix = false; // mix stereo input to mono before cava
+  bool decimate = false; // reduce the sample rate before cava
+  int decimation = 1;    // input rate divided by the cava rate
   double framerate = 25;
   int autosens = 0;
   double noise_reduction = 0.1; // 0.0: noisy 1.0: smooth
+  bool exact_framerate = false; // smooth with the exact execution rate
+  bool fixed_point = false;     // process with integer arithmetic only
   int print_freq_bands = false;
   std::vector<int> cutoffs = {50, 10000}; // cava low_cutoff and high_cutoff
+  std::string in_file_name = "-";
+  std::string out_file_name = "-";
   FILE *in_file = stdin;
   FILE *out_file = stdout;
 
-  void print_freq_bands_line(float *freqs) const;
-  void print_freq_vals_line(const std::vector<double> &frame_bars) const;
+  std::string server_socket; // run as a server listening on this socket
+  int server_workers = 0;    // number of worker threads, 0: one per CPU
+  bool server_local_plans = false; // plans in huge pages on worker nodes
+
+  std::string cache_dir;                        // cache results in this dir
+  double cache_max_size = 1024.0 * 1024 * 1024; // bytes
+
+  double start_time = 0;    // seconds into the input to start output
+  double duration = 0;      // seconds of output, 0: to the end of the input
+  double warm_up_time = -1; // seconds processed before start, for smoothing,
+                            // -1: until the smoothing settles
+  bool lock_memory = false; // lock memory after initialisation
+  int rt_priority = 0;      // SCHED_FIFO priority, 0: normal scheduling
+  std::vector<int> cpus;    // run on these CPUs, empty: any CPU
+  bool print_stats = false; // print frame timing statistics
+
+  bool use_uring = false;  // use io_uring for file input and output
+  bool follow = false;     // wait for more input at the end of the input
+  int chunk_idx = 0;       // index of the chunk of the input to output
+  int num_chunks = 0;      // number of chunks, 0: do not split input
+
+  std::string pyramid_file; // also write the frames to a pyramid file
+  std::string index_file;   // write output offsets of frames to this file
+  int index_interval = 100; // frames between index entries
+
+  bool print_loudness = false; // print the frame levels after the bars
+  std::string loudness_file;   // write the frame levels to this file
+
+  std::string checkpoint_file;     // save state to resume from to this file
+  double checkpoint_interval = 60; // seconds of audio between checkpoints
+
+  int print_freq_bands_line(FILE *out, const float *freqs) const;
+  bool has_stereo_frames() const { return channels == 2 && !downmix; }
+  double get_bar_value(const double *frame_bars, int idx) const;
+  int print_freq_vals_line(FILE *out, const double *frame_bars,
+                           const FrameLevels *levels = nullptr) const;
+  std::string get_cache_options() const;
+  Status write_spectrum(FILE *in, FILE *out, CavaPlan *plan);
+  Status resume_from_checkpoint(SpectrumGenerator &generator, FILE *in,
+                                FILE *out, bool *resumed);
+  Status write_checkpoint(const SpectrumGenerator &generator, FILE *out,
+                          Checkpoint &checkpoint);
+  bool has_time_range() const { return start_time > 0 || duration > 0; }
+  bool has_frame_range() const { return has_time_range() || num_chunks; }
+  Status get_frame_range(FILE *in, uint64_t *first_frame,
+                         uint64_t *last_frame) const;
+  Status seek_input(SpectrumGenerator &generator, FILE *in, uint64_t frames);
+  Status follow_input(SpectrumGenerator &generator, FILE *in, FILE *out,
+                      const bool &finished);
+  bool uring_input(SpectrumGenerator &generator, FILE *in,
+                   const bool &finished, Status *stat);
+  FILE *open_uring_output(FILE *out);
+  Status set_realtime_options() const;
+  Status read_option(char c, char *arg);
+  Status open_files(const std::string &dir = "");
 
 public:
   CavaFilter() : ProgramOpts("cava_filter") {}
   ~CavaFilter();
   void process_command_line(int argc, char **argv);
+  Status read_job_args(const std::string &cwd, std::vector<std::string> &args,
+                       int fd);
   void usage();
-  Status generate_spectrum_file();
+  CavaPlanParams get_plan_params() const;
+  Status generate_spectrum_file(CavaPlan *plan = nullptr);
+  bool is_server() const { return !server_socket.empty(); }
+  Status run_server();
 };
 
 CavaFilter::~CavaFilter()
@@ -77,123 +163,633 @@ CavaFilter::~CavaFilter()
   }
 }
 
-void CavaFilter::print_freq_bands_line(float *freqs) const
+// return the number of characters printed
+int CavaFilter::print_freq_bands_line(FILE *out, const float *freqs) const
 {
+  int len = 0;
   if (print_freq_bands) {
     for (int ch = 0; ch < channels_out; ch++)
       for (int i = 0; i < bars_per_channel; i++)
-        fprintf(out_file, "%4d ", (int)freqs[i]);
-    fprintf(out_file, "\n");
+        len += fprintf(out, "%4d ", (int)freqs[i]);
+    len += fprintf(out, "\n");
   }
+  return len;
+}
+
+double CavaFilter::get_bar_value(const double *frame_bars, int idx) const
+{
+  // mono frames give the same bars for both output channels
+  if (!has_stereo_frames())
+    return frame_bars[idx % bars_per_channel];
+  return (channels_out == 2)
+             ? frame_bars[idx]
+             : (frame_bars[idx] + frame_bars[idx + bars_per_channel]) / 2;
+}
+
+// return the number of characters printed
+int print_levels(FILE *out, const FrameLevels &levels)
+{
+  return fprintf(out, "%6.1f %6.1f %6.1f %6.1f ", levels.rms, levels.peak,
+                 levels.momentary, levels.short_term);
 }
 
-void CavaFilter::print_freq_vals_line(
-    const std::vector<double> &frame_bars) const
+// return the number of characters printed
+int CavaFilter::print_freq_vals_line(FILE *out, const double *frame_bars,
+                                     const FrameLevels *levels) const
 {
+  int len = 0;
   int num_bars_out = bars_per_channel * channels_out;
-  for (int i = 0; i < num_bars_out; i++) {
-    double bar_ht =
-        (channels_out == 2)
-            ? frame_bars[i]
-            : (frame_bars[i] + frame_bars[i + bars_per_channel]) / 2;
-    fprintf(out_file, "%4d ", (int)bar_ht);
-  }
-  fprintf(out_file, "\n");
+  for (int i = 0; i < num_bars_out; i++)
+    len += fprintf(out, "%4d ", (int)get_bar_value(frame_bars, i));
+  if (levels)
+    len += print_levels(out, *levels);
+  len += fprintf(out, "\n");
+  return len;
+}
+
+CavaPlanParams CavaFilter::get_plan_params() const
+{
+  return {bars_per_channel, rate / decimation, has_stereo_frames() ? 2 : 1,
+          autosens, noise_reduction, cutoffs[0], cutoffs[1]};
+}
+
+std::string CavaFilter::get_cache_options() const
+{
+  // every option that changes the output
+  std::string options =
+      msg_str("b=%d f=%.17g c=%d,%d n=%.17g a=%d R=%d C=%d S=%d F=%d",
+              bars_per_channel, framerate, cutoffs[0], cutoffs[1],
+              noise_reduction, autosens, rate, channels, channels_out,
+              print_freq_bands);
+  if (has_time_range())
+    options += msg_str(" s=%.17g d=%.17g", start_time, duration);
+  if (exact_framerate)
+    options += " E=1";
+  if (fixed_point)
+    options += " X=1";
+  if (downmix)
+    options += " M=1";
+  if (decimate)
+    options += " r=1";
+  if (print_loudness)
+    options += " l=1";
+  if (num_chunks)
+    options += msg_str(" x=%d,%d", chunk_idx, num_chunks);
+  if (has_frame_range())
+    options += msg_str(" w=%.17g", warm_up_time);
+  return options;
+}
+
+Status CavaFilter::get_frame_range(FILE *in, uint64_t *first_frame,
+                                   uint64_t *last_frame) const
+{
+  *first_frame = 0;
+  *last_frame = UINT64_MAX;
+  if (has_time_range()) {
+    *first_frame = round(start_time * framerate);
+    if (duration > 0)
+      *last_frame = *first_frame + std::max(1.0, round(duration * framerate));
+  }
+  else if (num_chunks) {
+    // split the frames evenly, estimating the total from the input size.
+    // The last chunk runs to the end, so the chunks always cover the input
+    struct stat st;
+    off_t pos = ftello(in);
+    if (pos < 0 || fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode))
+      return Status::error("chunks need an input file");
+    double secs = (double)(st.st_size - pos) / (sizeof(int16_t) * channels) /
+                  rate;
+    uint64_t total_frames = secs * framerate;
+    *first_frame = total_frames * chunk_idx / num_chunks;
+    if (chunk_idx < num_chunks - 1)
+      *last_frame = total_frames * (chunk_idx + 1) / num_chunks;
+  }
+
+  return Status::ok();
 }
 
 namespace {
-bool is_odd(int num) { return num % 2; }
+// timing of frame output, to measure jitter
+class FrameTimeStats {
+private:
+  std::chrono::steady_clock::time_point prev;
+  uint64_t frames = 0;
+  double sum = 0;    // intervals in seconds
+  double sum_sq = 0; // squared intervals
+  double min = INFINITY;
+  double max = 0;
+
+public:
+  void add()
+  {
+    auto now = std::chrono::steady_clock::now();
+    if (frames++ > 0) {
+      double interval = std::chrono::duration<double>(now - prev).count();
+      sum += interval;
+      sum_sq += interval * interval;
+      min = std::min(min, interval);
+      max = std::max(max, interval);
+    }
+    prev = now;
+  }
+
+  void print(FILE *file, double framerate) const
+  {
+    fprintf(file, "frames:         %llu\n", (unsigned long long)frames);
+    if (frames < 2)
+      return;
+    double n = frames - 1;
+    double mean = sum / n;
+    double std_dev = sqrt(std::max(0.0, sum_sq / n - mean * mean));
+    fprintf(file, "frame period:   %.3f ms\n", 1000 / framerate);
+    fprintf(file, "interval mean:  %.3f ms\n", 1000 * mean);
+    fprintf(file, "interval min:   %.3f ms\n", 1000 * min);
+    fprintf(file, "interval max:   %.3f ms\n", 1000 * max);
+    fprintf(file, "jitter std dev: %.3f ms\n", 1000 * std_dev);
+  }
 };
 
+// push a block of samples in spans, to stop soon after the last frame
+void push_samples(SpectrumGenerator &generator, const int16_t *samples,
+                  size_t num, const bool &finished)
+{
+  const size_t span_len = 1 << 14;
+  for (size_t pos = 0; pos < num && !finished; pos += span_len)
+    generator.push(samples + pos, std::min(span_len, num - pos));
+}
+}; // namespace
 
-Status CavaFilter::generate_spectrum_file()
+Status CavaFilter::seek_input(SpectrumGenerator &generator, FILE *in,
+                              uint64_t frames)
 {
-  Status stat;
-  auto *plan = cava_init(bars_per_channel, rate, channels, autosens,
-                         noise_reduction, cutoffs[0], cutoffs[1]);
+  generator.skip_frames(frames);
+  uint64_t bytes = generator.get_frame_samples() * sizeof(int16_t);
+  if (ftell(in) >= 0) {
+    if (fseeko(in, bytes, SEEK_CUR) != 0)
+      return Status::error(std::string("seeking input: ") + strerror(errno));
+    return Status::ok();
+  }
+
+  // input cannot seek, read up to the position
+  std::vector<char> buf(1 << 16);
+  while (bytes > 0) {
+    size_t num_read = fread(buf.data(), 1, std::min(bytes, buf.size()), in);
+    if (num_read == 0)
+      break;
+    bytes -= num_read;
+  }
+  if (ferror(in))
+    return Status::error(std::string("reading input: ") + strerror(errno));
+
+  return Status::ok();
+}
 
-  if (print_freq_bands)
-    print_freq_bands_line(plan->cut_off_frequency);
+Status CavaFilter::resume_from_checkpoint(SpectrumGenerator &generator,
+                                          FILE *in, FILE *out, bool *resumed)
+{
+  *resumed = false;
+  if (ftell(in) < 0)
+    return Status::error("checkpoints need an input file that can seek");
+  if (ftell(out) < 0)
+    return Status::error("checkpoints need an output file (-o)");
+
+  // the output is opened for appending, truncate to the checkpoint
+  off_t output_offset = 0;
+  Checkpoint checkpoint;
+  if (access(checkpoint_file.c_str(), F_OK) == 0) {
+    Status stat = checkpoint.read(checkpoint_file);
+    if (!stat)
+      return stat;
+    if (checkpoint.options != get_cache_options())
+      return Status::error("checkpoint file '" + checkpoint_file +
+                           "' was saved with different options");
+    if (!(stat = generator.load_state(checkpoint.state)))
+      return Status::error("checkpoint file '" + checkpoint_file +
+                           "': " + stat.msg());
+    if (checkpoint.input_offset !=
+            generator.get_frame_samples() * sizeof(int16_t) ||
+        fseek(in, checkpoint.input_offset, SEEK_SET) != 0)
+      return Status::error("could not resume input from checkpoint file '" +
+                           checkpoint_file + "'");
+    output_offset = checkpoint.output_offset;
+    *resumed = true;
+  }
 
-  size_t input_len = input_len_per_channel * channels; // samples buffier len
-  int bars_total = bars_per_channel * channels; // total bar vals in cava_out
+  if (fflush(out) != 0 || ftruncate(fileno(out), output_offset) != 0)
+    return Status::error(std::string("could not resume output: ") +
+                         strerror(errno));
 
-  std::vector<int16_t> cava_in_int16(input_len); // raw sample buffer
-  std::vector<double> cava_in(input_len);        // double sample buffer
-  std::vector<double> cava_out(bars_total);      // cava exec bar values
-  std::vector<double> frame_bars(bars_total);    // frame bar values
+  return Status::ok();
+}
+
+Status CavaFilter::write_checkpoint(const SpectrumGenerator &generator,
+                                    FILE *out, Checkpoint &checkpoint)
+{
+  if (fflush(out) != 0)
+    return Status::error(std::string("writing output: ") + strerror(errno));
+  checkpoint.options = get_cache_options();
+  checkpoint.input_offset = generator.get_frame_samples() * sizeof(int16_t);
+  checkpoint.output_offset = ftell(out);
+  generator.save_state(&checkpoint.state);
+  return checkpoint.write(checkpoint_file);
+}
 
-  const double samples_per_frame = (double)(rate * channels) / framerate;
-  // + channels sample to ensure being able to hold fractional part of sample
-  int execs_per_frame = ceil((samples_per_frame + channels) / input_len);
-  int samples_per_exec = samples_per_frame / execs_per_frame;
-  int samples_remainder =
-      samples_per_frame - execs_per_frame * samples_per_exec;
+Status CavaFilter::follow_input(SpectrumGenerator &generator, FILE *in,
+                                FILE *out, const bool &finished)
+{
+  struct stat st;
+  if (fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode))
+    return Status::error("follow mode needs an input file");
 
-  // Find the fractional part of the sample that would be lost each frame
-  double intpart;
-  double sample_fraction_per_frame = modf(samples_per_frame, &intpart);
+  // watch the open file, which may not be reachable by its name
+  int notify_fd = inotify_init1(IN_CLOEXEC);
+  if (notify_fd < 0 ||
+      inotify_add_watch(notify_fd,
+                        msg_str("/proc/self/fd/%d", fileno(in)).c_str(),
+                        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF) < 0) {
+    Status stat = Status::error(std::string("watching input: ") +
+                                strerror(errno));
+    if (notify_fd >= 0)
+      close(notify_fd);
+    return stat;
+  }
 
-  double current_accumulated_sample_fractions = 0.0;
-  int finished = 0; // has all the data been read (or error)
+  // a read may end part way through a sample, which is kept for the next
+  std::vector<int16_t> cava_in_int16(input_block_len);
+  char *buf = (char *)cava_in_int16.data();
+  const size_t buf_size = cava_in_int16.size() * sizeof(int16_t);
+  size_t fill = 0;
+  bool input_removed = false;
+  Status stat;
   while (!finished) {
-    for (int bar_idx = 0; bar_idx < bars_total; bar_idx++)
-      frame_bars[bar_idx] = 0;
-
-    for (int read_idx = 0; read_idx < execs_per_frame; read_idx++) {
-      // Add 1 to each of the first execs to include the samples remainder
-      size_t read_len = samples_per_exec + (read_idx < samples_remainder);
-
-      // ensure that buffer is filled with even number of samples
-      if (channels == 2 && is_odd(read_len)) {
-        // adjust by one sample, add or subtract on alternate iterations
-        const int offset = is_odd(read_idx) ? -1 : 1;
-        read_len += offset;
-        current_accumulated_sample_fractions -= offset; // balance accounts
-      }
-
-      // Add an extra samples if needed to the last exec. There should always
-      // be room for this from the calculation of execs_per_frame
-      if (read_idx == execs_per_frame - 1) {
-        current_accumulated_sample_fractions += sample_fraction_per_frame;
-        if (current_accumulated_sample_fractions >= channels) {
-          read_len += channels;
-          current_accumulated_sample_fractions -= channels;
-        }
-      }
-
-      size_t actual_num_read =
-          fread(cava_in_int16.data(), sizeof(int16_t), read_len, in_file);
-      if (actual_num_read < read_len) { // end of stream or error
-        finished = 1;
-        if (ferror(in_file))
-          stat.set_error(std::string("reading input: ") + strerror(errno));
-        break;
-      }
-
-      // convert samples to doubles for cava
-      for (size_t i = 0; i < read_len; i++)
-        cava_in[i] = (int)cava_in_int16[i];
-
-      cava_execute(cava_in.data(), read_len, cava_out.data(), plan);
-
-      // add weighted bar values
-      for (int bar_idx = 0; bar_idx < bars_total; bar_idx++)
-        frame_bars[bar_idx] += cava_out[bar_idx] / execs_per_frame;
+    size_t num_read = fread(buf + fill, 1, buf_size - fill, in);
+    if (num_read > 0) {
+      fill += num_read;
+      size_t num_samples = fill / sizeof(int16_t);
+      push_samples(generator, cava_in_int16.data(), num_samples, finished);
+      fill -= num_samples * sizeof(int16_t);
+      if (fill)
+        buf[0] = buf[num_samples * sizeof(int16_t)];
+      continue;
     }
+    if (ferror(in)) {
+      stat.set_error(std::string("reading input: ") + strerror(errno));
+      break;
+    }
+    if (input_removed)
+      break; // all the data has been read
 
-    if (finished) // end of stream or error
+    // at the current end of the input, wait for it to change
+    clearerr(in);
+    fflush(out);
+    char events[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t len = read(notify_fd, events, sizeof(events));
+    if (len < 0 && errno != EINTR) {
+      stat.set_error(std::string("watching input: ") + strerror(errno));
       break;
+    }
+    for (ssize_t i = 0; i < len;) {
+      auto event = (const struct inotify_event *)(events + i);
+      // the file is not deleted while open, but its last link is removed
+      if (event->mask & (IN_MOVE_SELF | IN_IGNORED) ||
+          (event->mask & IN_ATTRIB && fstat(fileno(in), &st) == 0 &&
+           st.st_nlink == 0))
+        input_removed = true;
+      i += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  close(notify_fd);
+  return stat;
+}
+
+// return false if io_uring could not be used, and nothing was read
+bool CavaFilter::uring_input(SpectrumGenerator &generator, FILE *in,
+                             const bool &finished, Status *stat)
+{
+  struct stat st;
+  off_t offset = ftello(in);
+  if (offset < 0 || fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+
+  UringReader reader;
+  if (!reader.init(fileno(in), offset, input_block_len * sizeof(int16_t)))
+    return false;
 
-    print_freq_vals_line(frame_bars);
+  // blocks have an even length, except at the end of the input
+  const char *data;
+  size_t len;
+  while (!finished && (*stat = reader.read(&data, &len)) && len > 0)
+    push_samples(generator, (const int16_t *)data, len / sizeof(int16_t),
+                 finished);
+
+  return true;
+}
+
+// return a warning for options that are not permitted
+Status CavaFilter::set_realtime_options() const
+{
+  std::vector<std::string> failed;
+  if (!cpus.empty()) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus)
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &cpu_set);
+    if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+      failed.push_back(std::string("setting CPU affinity: ") +
+                       strerror(errno));
   }
 
-  cava_destroy(plan);
-  free(plan);
+  if (rt_priority) {
+    struct sched_param param;
+    param.sched_priority = rt_priority;
+    if (sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+      failed.push_back(std::string("setting realtime scheduling: ") +
+                       strerror(errno));
+  }
+
+  // later allocations are also locked
+  if (lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+    failed.push_back(std::string("locking memory: ") + strerror(errno));
+
+  if (!failed.empty())
+    return Status::warning(join(failed.begin(), failed.end(), ", "));
+
+  return Status::ok();
+}
+
+// return nullptr if io_uring could not be used
+FILE *CavaFilter::open_uring_output(FILE *out)
+{
+  struct stat st;
+  if (fflush(out) != 0 || fstat(fileno(out), &st) != 0 ||
+      !S_ISREG(st.st_mode))
+    return nullptr;
+
+  int fd = dup(fileno(out));
+  FILE *uring_out = nullptr;
+  if (fd >= 0 && !(uring_out = open_uring_write_stream(fd)))
+    close(fd);
+  return uring_out;
+}
+
+Status CavaFilter::write_spectrum(FILE *in, FILE *out, CavaPlan *plan)
+{
+  SpectrumGenerator generator;
+  SampleConversion conversion;
+  conversion.stereo_downmix = channels == 2 && downmix;
+  conversion.decimation = decimation;
+  Status stat = generator.init(get_plan_params(), framerate, plan, conversion);
+  if (!stat)
+    return stat;
+  generator.set_exact_framerate(exact_framerate);
+  if (!(stat = generator.set_fixed_point(fixed_point)))
+    return stat;
+
+  // the levels are measured from the same samples as the bars
+  LoudnessMeter loudness;
+  const bool measure_loudness = print_loudness || !loudness_file.empty();
+  if (measure_loudness) {
+    if (!(stat = loudness.init(rate, channels)))
+      return stat;
+    generator.set_loudness_meter(&loudness);
+  }
+
+  bool resumed = false;
+  uint64_t checkpoint_frames = 0;
+  if (!checkpoint_file.empty()) {
+    if (!(stat = resume_from_checkpoint(generator, in, out, &resumed)))
+      return stat;
+    checkpoint_frames = std::max(1.0, round(checkpoint_interval * framerate));
+  }
+
+  // frames before first_frame only warm up the smoothing, and frames after
+  // last_frame are not output
+  uint64_t first_frame;
+  uint64_t last_frame;
+  if (!(stat = get_frame_range(in, &first_frame, &last_frame)))
+    return stat;
+  // by default until the smoothing settles, and at least 5 seconds, for
+  // the state that the settle time does not cover, e.g. a falling bar
+  double warm_up = warm_up_time;
+  if (warm_up < 0)
+    warm_up = std::max(5.0, generator.get_settle_time());
+  const double warm_up_frames = round(warm_up * framerate);
+  if (first_frame > warm_up_frames)
+    if (!(stat = seek_input(generator, in,
+                            first_frame - (uint64_t)warm_up_frames)))
+      return stat;
+
+  // frames are written asynchronously to an output file with io_uring
+  FILE *uring_out = nullptr;
+  if (use_uring && checkpoint_file.empty())
+    uring_out = open_uring_output(out);
+  FILE *frame_out = uring_out ? uring_out : out;
+
+  uint64_t output_offset = 0;
+  if (print_freq_bands && !resumed)
+    output_offset +=
+        print_freq_bands_line(frame_out, generator.get_cut_off_frequencies());
+
+  FrameIndexWriter frame_index;
+  if (!index_file.empty())
+    if (!(stat = frame_index.open(index_file, index_interval, framerate,
+                                  first_frame)))
+      return stat;
+
+  int num_bars_out = bars_per_channel * channels_out;
+  PyramidWriter pyramid;
+  std::vector<float> pyramid_bars(num_bars_out);
+  if (!pyramid_file.empty())
+    if (!(stat = pyramid.open(pyramid_file, num_bars_out, framerate)))
+      return stat;
+
+  FILE *loudness_out = nullptr;
+  if (!loudness_file.empty()) {
+    loudness_out = fopen(loudness_file.c_str(), "w");
+    if (!loudness_out)
+      return Status::error("could not open file for writing '" +
+                           loudness_file + "': " + strerror(errno));
+  }
+
+  // the plan and buffers are allocated
+  Status rt_stat = set_realtime_options();
+  if (!rt_stat.is_ok())
+    warning(rt_stat.msg());
+
+  FrameTimeStats time_stats;
+  Checkpoint checkpoint;
+  Status checkpoint_stat;
+  bool finished = false;
+  bool alloc_check_armed = false;
+  generator.set_frame_handler([&](const double *frame_bars) {
+    uint64_t frame_count = generator.get_frame_count();
+    if (frame_count <= first_frame || frame_count > last_frame) {
+      finished = frame_count >= last_frame;
+      return;
+    }
+    if (print_stats)
+      time_stats.add();
+    frame_index.add_frame(output_offset);
+    const FrameLevels *levels =
+        measure_loudness ? &loudness.get_frame_levels() : nullptr;
+    output_offset += print_freq_vals_line(
+        frame_out, frame_bars, print_loudness ? levels : nullptr);
+    if (loudness_out) {
+      print_levels(loudness_out, *levels);
+      fprintf(loudness_out, "\n");
+    }
+    if (!pyramid_file.empty()) {
+      for (int i = 0; i < num_bars_out; i++)
+        pyramid_bars[i] = get_bar_value(frame_bars, i);
+      AllocCheck::Pause pause(pyramid.next_frame_starts_level());
+      pyramid.add_frame(pyramid_bars.data());
+    }
+    finished = frame_count == last_frame;
+    if (checkpoint_frames &&
+        generator.get_frame_count() % checkpoint_frames == 0 &&
+        checkpoint_stat.is_ok()) {
+      AllocCheck::Pause pause;
+      checkpoint_stat = write_checkpoint(generator, out, checkpoint);
+    }
+    // the first frame has allocated any buffers, count allocations after it
+    if (!alloc_check_armed) {
+      AllocCheck::arm();
+      alloc_check_armed = true;
+    }
+  });
+
+  if (follow)
+    stat = follow_input(generator, in, out, finished);
+  else if (use_uring && uring_input(generator, in, finished, &stat))
+    ; // input was read
+  else {
+    struct stat st;
+    bool is_file = fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode);
+    std::vector<int16_t> cava_in_int16(is_file ? input_block_len
+                                               : stream_block_len);
+    size_t num_read;
+    while (!finished &&
+           (num_read = fread(cava_in_int16.data(), sizeof(int16_t),
+                             cava_in_int16.size(), in)) > 0)
+      push_samples(generator, cava_in_int16.data(), num_read, finished);
+    if (ferror(in))
+      stat.set_error(std::string("reading input: ") + strerror(errno));
+  }
+
+  uint64_t num_allocs = AllocCheck::disarm();
+  if (num_allocs && stat)
+    stat.set_error(msg_str("%llu heap allocations in the frame loop",
+                           (unsigned long long)num_allocs));
+
+  if (uring_out) {
+    if (fclose(uring_out) != 0 && stat)
+      stat.set_error(std::string("writing output: ") + strerror(errno));
+    // the writes were made at explicit offsets, move past them
+    fseeko(out, 0, SEEK_END);
+  }
+
+  if (stat) {
+    if (!pyramid_file.empty())
+      stat = pyramid.close();
+    if (stat && !index_file.empty())
+      stat = frame_index.close();
+  }
+
+  if (loudness_out) {
+    // the last line is the integrated loudness of all the samples processed
+    fprintf(loudness_out, "%6.1f\n", loudness.get_integrated());
+    bool write_failed = ferror(loudness_out);
+    write_failed |= fclose(loudness_out) != 0;
+    if (write_failed && stat)
+      stat.set_error("writing '" + loudness_file + "': " + strerror(errno));
+  }
+
+  if (print_stats)
+    time_stats.print(stderr, framerate);
+
+  if (stat && !checkpoint_file.empty()) {
+    // finished, the checkpoint is no longer needed
+    remove(checkpoint_file.c_str());
+    if (!checkpoint_stat)
+      stat.set_warning(checkpoint_stat.msg());
+  }
 
   return stat;
 }
 
+Status CavaFilter::generate_spectrum_file(CavaPlan *plan)
+{
+  if (cache_dir.empty())
+    return write_spectrum(in_file, out_file, plan);
+
+  ResultCache cache(cache_dir, cache_max_size);
+  FILE *input;
+  bool found;
+  Status stat = cache.lookup(in_file, get_cache_options(), &input, &found);
+  if (!stat)
+    return stat;
+
+  if (!found) {
+    FILE *entry;
+    if (!(stat = cache.create_entry(&entry)))
+      return stat;
+    stat = write_spectrum(input, entry, plan);
+    Status close_stat = cache.close_entry(stat.is_ok());
+    if (!stat || !(stat = close_stat))
+      return stat;
+  }
+
+  stat = cache.read_entry(out_file);
+  cache.evict();
+  return stat;
+}
+
+namespace {
+// ultragetopt keeps some parsing state in a global
+std::mutex getopt_mutex;
+
+Status run_job(const std::string &cwd, std::vector<std::string> &args, int fd,
+               CavaPlanPool &pool)
+{
+  CavaFilter job;
+  Status stat = job.read_job_args(cwd, args, fd);
+  if (!stat)
+    return stat;
+
+  auto params = job.get_plan_params();
+  CavaPlan plan;
+  stat = pool.acquire(params, &plan);
+  if (!stat)
+    return stat;
+  stat = job.generate_spectrum_file(&plan);
+  pool.release(params, std::move(plan));
+  return stat;
+}
+}; // namespace
+
+Status CavaFilter::run_server()
+{
+  int workers = server_workers;
+  if (workers == 0)
+    workers = std::max(1u, std::thread::hardware_concurrency());
+
+  CavaServer server(run_job, workers);
+  server.set_local_plans(server_local_plans);
+  // the plans most likely to be used are for the server's own options
+  Status stat = server.prewarm(get_plan_params());
+  if (!stat)
+    return stat;
+
+  // worker threads inherit the settings
+  Status rt_stat = set_realtime_options();
+  if (!rt_stat.is_ok())
+    warning(rt_stat.msg());
+  return server.run(server_socket);
+}
+
 void CavaFilter::usage()
 {
   fprintf(stdout, R"(
@@ -210,129 +806,522 @@ program reads from standard input.
              be a partial frame and no bars value line will be printed for it
   -S         stereo output, print the right channel bars followed on the line
              by the left channel bars
+  -M         mix stereo input to mono before processing, rather than
+             averaging the bars of the two channels, for half of the work.
+             The bars are lower where the channels are out of phase
   -n <fact>  noise reduction, a number between 0.0 noisy, and 1.0 smooth
              (default: 0.1)
+  -E         smooth with the exact rate of cava executions for the
+             framerate, rather than the cava estimate, which depends on the
+             earlier input and settles over some seconds. Chunks and time
+             ranges then match a single run more closely, but the output
+             differs slightly from the default
+  -X         process with integer arithmetic, for processors with slow
+             floating point. The cava executions are fixed point, and only
+             the average of the executions in each frame, and the output,
+             are floating point. The smoothing uses the exact rate as with
+             -E, and the bar values differ from those of -E by at most 4%% of
+             the largest bar value, except in a few frames with gravity
+             smoothing. Not for autosens, -r, -l, -L, or sample rates above
+             300000
+  -l         print the levels of each frame after its bars: the RMS and peak
+             sample levels in dBFS, and the EBU R128 momentary and
+             short-term loudness in LUFS, measured in the same pass
+  -L <file>  write the levels of each frame, as for -l, to file, one line
+             for each frame, followed by a line with the integrated
+             loudness of all the input processed, including any warm-up
   -a <auto>  value for the cava autosens setting (default: 0 no autosens)
   -c <frqs>  low and high cutoff frequencies for cava, two integers
              separated by a comma (default: 50,10000)
   -F         the first line printed is the frequencies of the bands
   -R <hz>    input audio sample rate (default: 44100)
+  -r         reduce the sample rate before processing, by the largest factor
+             up to 16 that keeps the high cutoff frequency, with an
+             anti-alias filter. For high sample rates, this makes the FFTs
+             smaller
   -C <cnls>  input audio channels 1-mono, 2-stereo (default: 2)
+  -s <secs>  start output at time secs in the input. An input file is read
+             from this point less the warm-up time (default: 0)
+  -d <secs>  output only secs seconds of audio (default: to end of input)
+  -w <secs>  warm-up time, the seconds of audio processed before the start
+             time to settle the smoothing but not output (default: the time
+             the smoothing takes to settle, from the noise reduction and the
+             framerate, e.g. 37 at -n 0.8 and 25 fps, and at least 5)
+  -t         follow the input file as it grows, like tail -f, waiting for
+             more input at the end of the file until the file is removed
+             or renamed
+  -x <i,n>   split the input file into n chunks of frames, and output only
+             chunk i (0 to n-1), starting after the warm-up time. Join the
+             chunk outputs with cava_filter_merge
+  -P <file>  also write the frames to a pyramid file, which holds the
+             frames at the framerate and at successively halved framerates,
+             with the maximum and mean of each bar, for fast access at any
+             zoom level (see spectrum_pyramid.hpp)
+  -I <file>  write an index of the output offsets of frames to file, for
+             finding frames without reading the whole output, e.g. with
+             cava_filter_seek. An optional number of frames between index
+             entries may follow a comma (default: 100)
   -o <file>  write output to file (default: write to standard output)
+  -U         read input files and write output files with io_uring, with
+             several large requests in flight, if supported by the build
+             and the system (otherwise read and write as normal)
+  -m         lock memory after initialisation, to avoid page faults
+  -y <prio>  run with realtime scheduling (SCHED_FIFO) at priority prio
+             (1-99), if permitted
+  -A <cpus>  run only on CPUs in the comma separated list cpus
+  -v         print frame timing statistics to standard error at the end,
+             including the jitter in the interval between frames
+  -D <sock>  run as a server, accepting jobs on UNIX socket sock. A job has
+             the arguments of a cava_filter command, and its input and output
+             are sent over the socket when they are not files, see
+             cava_filter_client. Only the user running the server may
+             send jobs, and a job cannot use -t. Plans for the other
+             options given are prepared in advance
+  -j <num>   number of jobs the server runs at once (default: 0, one for
+             each CPU)
+  -H         server plans are allocated from huge pages, by each worker on
+             its own NUMA node, for servers that hold many plans. Workers
+             are spread over the nodes, and plans are only reused on the
+             node where they were allocated
+  -K <dir>   cache results in directory dir, and output the cached result
+             when the same input is processed with the same options. An
+             optional maximum cache size in MiB may follow a comma, e.g.
+             /tmp/cava_cache,200, least recently used results are removed
+             to keep within it (default: 1024)
+  -k <file>  save checkpoints to file, and if file exists then resume the
+             run from its checkpoint. An optional interval in seconds of
+             audio between checkpoints may follow a comma (default: 60).
+             Needs an input file and an output file (-o), and the file is
+             removed when the run finishes
 
   )",
           get_program_name().c_str(), help_ver_text);
 }
 
+Status CavaFilter::read_option(char c, char *arg)
+{
+  Status stat;
+  switch (c) {
+  case 'b':
+    if (!(stat = read_int(arg, &bars_per_channel)))
+      return stat;
+    if (bars_per_channel < 2 || bars_per_channel > 200)
+      return Status::error("select between 2 and 200 bars");
+    break;
+
+  case 'f':
+    if (!(stat = read_double(arg, &framerate)))
+      return stat;
+    if (framerate <= 0)
+      return Status::error("framerate must be greater than 0");
+    break;
+
+  case 'S':
+    channels_out = 2;
+    break;
+
+  case 'M':
+    downmix = true;
+    break;
+
+  case 'r':
+    decimate = true;
+    break;
+
+  case 'E':
+    exact_framerate = true;
+    break;
+
+  case 'l':
+    print_loudness = true;
+    break;
+
+  case 'L':
+    loudness_file = arg;
+    break;
+
+  case 'X':
+    fixed_point = true;
+    break;
+
+  case 'n':
+    if (!(stat = read_double(arg, &noise_reduction)))
+      return stat;
+    if (noise_reduction < 0.0 || noise_reduction > 1.0)
+      return Status::error("noise reduction must be between 0.0 and 1.0");
+    break;
+
+  case 'a':
+    if (!(stat = read_int(arg, &autosens)))
+      return stat;
+    if (autosens < 0)
+      return Status::error("autosens cannot be negative (0 to disable)");
+    break;
+
+  case 'c':
+    // read two positive integers
+    if (!(stat = read_int_list(arg, cutoffs, false, 2)))
+      return stat;
+    if (cutoffs.size() < 2)
+      return Status::error("must specify two cutoffs (low and high)");
+    if (cutoffs[0] < 1)
+      return Status::error("first cutoff (low) must be greater than 0");
+    if (cutoffs[1] <= cutoffs[0])
+      return Status::error(
+          "second cutoff (high) must be greater than first cutoff (low)");
+    break;
+
+  case 'F':
+    print_freq_bands = true;
+    break;
+
+  case 'R':
+    if (!(stat = read_int(arg, &rate)))
+      return stat;
+    if (rate < 1)
+      return Status::error("rate must be positive");
+    break;
+
+  case 'C':
+    if (strcmp(arg, "1") == 0)
+      channels = 1;
+    else if (strcmp(arg, "2") == 0)
+      channels = 2;
+    else
+      return Status::error("invalid number of channels, should be 1 or 2");
+    break;
+
+  case 'o':
+    out_file_name = arg;
+    break;
+
+  case 's':
+    if (!(stat = read_double(arg, &start_time)))
+      return stat;
+    if (start_time < 0)
+      return Status::error("start time cannot be negative");
+    break;
+
+  case 'd':
+    if (!(stat = read_double(arg, &duration)))
+      return stat;
+    if (duration <= 0)
+      return Status::error("duration must be greater than 0");
+    break;
+
+  case 'w':
+    if (!(stat = read_double(arg, &warm_up_time)))
+      return stat;
+    if (warm_up_time < 0)
+      return Status::error("warm-up time cannot be negative");
+    break;
+
+  case 't':
+    follow = true;
+    break;
+
+  case 'U':
+    use_uring = true;
+    break;
+
+  case 'm':
+    lock_memory = true;
+    break;
+
+  case 'y':
+    if (!(stat = read_int(arg, &rt_priority)))
+      return stat;
+    if (rt_priority < 1 || rt_priority > 99)
+      return Status::error("realtime priority must be between 1 and 99");
+    break;
+
+  case 'A':
+    if (!(stat = read_int_list(arg, cpus, true)))
+      return stat;
+    if (cpus.empty())
+      return Status::error("no CPUs given");
+    break;
+
+  case 'v':
+    print_stats = true;
+    break;
+
+  case 'x': {
+    std::vector<int> chunk;
+    if (!(stat = read_int_list(arg, chunk, false, 2)))
+      return stat;
+    if (chunk.size() < 2)
+      return Status::error("must specify a chunk index and number of chunks");
+    if (chunk[1] < 1)
+      return Status::error("number of chunks must be greater than 0");
+    if (chunk[0] < 0 || chunk[0] >= chunk[1])
+      return Status::error(
+          msg_str("chunk index must be between 0 and %d", chunk[1] - 1));
+    chunk_idx = chunk[0];
+    num_chunks = chunk[1];
+    break;
+  }
+
+  case 'P':
+    pyramid_file = arg;
+    break;
+
+  case 'I': {
+    index_file = arg;
+    // an optional interval may follow the last comma
+    auto pos = index_file.rfind(',');
+    if (pos != std::string::npos &&
+        read_int(index_file.c_str() + pos + 1, &index_interval)) {
+      if (index_interval < 1)
+        return Status::error("index interval must be greater than 0");
+      index_file.resize(pos);
+    }
+    if (index_file.empty())
+      return Status::error("index file not given");
+    break;
+  }
+
+  case 'k': {
+    checkpoint_file = arg;
+    // an optional interval may follow the last comma
+    auto pos = checkpoint_file.rfind(',');
+    if (pos != std::string::npos &&
+        read_double(checkpoint_file.c_str() + pos + 1, &checkpoint_interval)) {
+      if (checkpoint_interval <= 0)
+        return Status::error("checkpoint interval must be greater than 0");
+      checkpoint_file.resize(pos);
+    }
+    if (checkpoint_file.empty())
+      return Status::error("checkpoint file not given");
+    break;
+  }
+
+  case 'K': {
+    cache_dir = arg;
+    // an optional size may follow the last comma
+    auto pos = cache_dir.rfind(',');
+    double size_mib;
+    if (pos != std::string::npos &&
+        read_double(cache_dir.c_str() + pos + 1, &size_mib)) {
+      if (size_mib < 0)
+        return Status::error("cache size cannot be negative");
+      cache_max_size = size_mib * 1024 * 1024;
+      cache_dir.resize(pos);
+    }
+    if (cache_dir.empty())
+      return Status::error("cache directory not given");
+    break;
+  }
+
+  default:
+    return Status::error("unknown command line error");
+  }
+
+  return stat;
+}
+
+Status CavaFilter::open_files(const std::string &dir)
+{
+  // relative file names are relative to dir, if it is given
+  auto path = [&dir](const std::string &name) {
+    return (dir.empty() || name[0] == '/') ? name : dir + "/" + name;
+  };
+
+  if (!cache_dir.empty())
+    cache_dir = path(cache_dir);
+
+  if (downmix && channels_out == 2)
+    return Status::error("a downmix cannot be used with stereo output");
+
+  if (decimate)
+    decimation = Decimator::choose_factor(rate, cutoffs[1]);
+
+  if (num_chunks && has_time_range())
+    return Status::error("a chunk cannot be used with a time range");
+
+  if (follow && (num_chunks || !cache_dir.empty()))
+    return Status::error("follow mode cannot be used with a chunk or cache");
+
+  if (!pyramid_file.empty()) {
+    if (!cache_dir.empty() || !checkpoint_file.empty())
+      return Status::error(
+          "a pyramid file cannot be used with a cache or checkpoints");
+    pyramid_file = path(pyramid_file);
+  }
+
+  if (!index_file.empty()) {
+    if (!cache_dir.empty() || !checkpoint_file.empty())
+      return Status::error(
+          "an index file cannot be used with a cache or checkpoints");
+    index_file = path(index_file);
+  }
+
+  if (fixed_point && autosens)
+    return Status::error("fixed point processing cannot be used with autosens");
+
+  // the decimation filter and the loudness meter are floating point
+  if (fixed_point && (decimate || print_loudness || !loudness_file.empty()))
+    return Status::error(
+        "fixed point processing cannot be used with decimation or loudness");
+
+  if (print_loudness || !loudness_file.empty()) {
+    if (!checkpoint_file.empty())
+      return Status::error("loudness cannot be measured with checkpoints");
+    if (!loudness_file.empty()) {
+      if (!cache_dir.empty())
+        return Status::error("a loudness file cannot be used with a cache");
+      loudness_file = path(loudness_file);
+    }
+  }
+
+  if (!checkpoint_file.empty()) {
+    if (fixed_point || decimate)
+      return Status::error("checkpoints cannot be used with fixed point "
+                           "processing or decimation");
+    if (!cache_dir.empty())
+      return Status::error("checkpoints cannot be used with a cache");
+    if (has_frame_range())
+      return Status::error(
+          "checkpoints cannot be used with a time range or chunk");
+    checkpoint_file = path(checkpoint_file);
+  }
+
+  if (out_file_name != "-") {
+    // when resuming, the output is truncated to the checkpoint
+    const char *mode = checkpoint_file.empty() ? "w" : "a";
+    FILE *file = fopen(path(out_file_name).c_str(), mode);
+    if (!file)
+      return Status::error("could not open file for writing '" +
+                           out_file_name + "': " + strerror(errno));
+    out_file = file;
+  }
+
+  if (in_file_name != "-") {
+    FILE *file = fopen(path(in_file_name).c_str(), "r");
+    if (!file)
+      return Status::error("could not open file for reading '" +
+                           in_file_name + "': " + strerror(errno));
+    in_file = file;
+  }
+
+  return Status::ok();
+}
+
 void CavaFilter::process_command_line(int argc, char **argv)
 {
   opterr = 0;
   int c;
-  std::string file_name;
 
   handle_long_opts(argc, argv);
 
-  while ((c = getopt(argc, argv, ":ho:b:f:Sn:a:c:FR:C:")) != -1) {
+  while ((c = getopt(argc, argv,
+                     ":ho:b:f:SMErXlL:n:a:c:FR:C:"
+                     "s:d:w:tx:P:I:K:k:Umy:A:vD:j:H")) != -1) {
     if (common_opts(c, optopt))
       continue;
 
     switch (c) {
-    case 'b':
-      print_status_or_exit(read_int(optarg, &bars_per_channel), c);
-      if (bars_per_channel < 2 || bars_per_channel > 200)
-        error("select between 2 and 200 bars", c);
-      break;
-
-    case 'f':
-      print_status_or_exit(read_double(optarg, &framerate), c);
-      if (framerate <= 0)
-        error("framerate must be greater than 0", c);
+    case 'D':
+      server_socket = optarg;
       break;
 
-    case 'S':
-      channels_out = 2;
+    case 'j':
+      print_status_or_exit(read_int(optarg, &server_workers), c);
+      if (server_workers < 0)
+        error("number of jobs cannot be negative", c);
       break;
 
-    case 'n':
-      print_status_or_exit(read_double(optarg, &noise_reduction), c);
-      if (noise_reduction < 0.0 || noise_reduction > 1.0)
-        error("noise reduction must be between 0.0 and 1.0", c);
+    case 'H':
+      server_local_plans = true;
       break;
 
-    case 'a':
-      print_status_or_exit(read_int(optarg, &autosens), c);
-      if (autosens < 0)
-        error("autosens cannot be negative (0 to disable)", c);
-      break;
+    default:
+      print_status_or_exit(read_option(c, optarg), c);
+    }
+  }
 
-    case 'c':
-      // read two positive integers
-      print_status_or_exit(read_int_list(optarg, cutoffs, false, 2), c);
-      if (cutoffs.size() < 2)
-        error("must specify two cutoffs (low and high)", c);
-      if (cutoffs[0] < 1)
-        error("first cutoff (low) must be greater than 0", c);
-      if (cutoffs[1] <= cutoffs[0])
-        error("second cutoff (high) must be greater than first cutoff (low)",
-              c);
-      break;
+  if (argc - optind > 1)
+    error("too many arguments");
 
-    case 'F':
-      print_freq_bands = true;
-      break;
+  if (argc - optind == 1)
+    in_file_name = argv[optind];
 
-    case 'R':
-      print_status_or_exit(read_int(optarg, &rate), c);
-      if (rate < 1)
-        error("rate must be positive", c);
-      break;
+  if (!server_socket.empty() && (in_file_name != "-" || out_file_name != "-"))
+    error("input and output files cannot be given in server mode");
 
-    case 'C':
-      if(strcmp(optarg, "1") == 0)
-        channels = 1;
-      else if(strcmp(optarg, "2") == 0)
-        channels = 2;
-      else
-        error("invalid number of channels, should be 1 or 2", c);
-      break;
+  print_status_or_exit(open_files());
+}
 
-    case 'o':
-      file_name = optarg;
-      if (file_name == "-") {
-        out_file = stdout;
-      }
-      else {
-        out_file = fopen(file_name.c_str(), "w");
-        if (!out_file)
-          error("could not open file for writing '" + file_name +
-                "': " + strerror(errno));
-      }
-      break;
+Status CavaFilter::read_job_args(const std::string &cwd,
+                                 std::vector<std::string> &args, int fd)
+{
+  std::vector<char *> argv(1, const_cast<char *>("cava_filter"));
+  for (auto &arg : args)
+    argv.push_back(&arg[0]);
+  argv.push_back(nullptr);
+  int argc = argv.size() - 1;
 
-    default:
-      error("unknown command line error");
+  opterr = 0;
+  int c;
+  {
+    std::lock_guard<std::mutex> lock(getopt_mutex);
+    while ((c = getopt(argc, argv.data(),
+                       ":o:b:f:SMErXlL:n:a:c:FR:C:"
+                       "s:d:w:tx:P:I:K:k:U")) != -1) {
+      Status stat;
+      if (c == '?')
+        stat.set_error("unknown option");
+      else if (c == ':')
+        stat.set_error("missing argument");
+      else if (c == 't')
+        // the input may never end, and the job would hold a worker
+        stat.set_error("follow mode cannot be used in a server job");
+      else
+        stat = read_option(c, optarg);
+      if (!stat)
+        return Status::error(msg_str("option -%c: %s",
+                                     (c == '?' || c == ':') ? optopt : c,
+                                     stat.c_msg()));
     }
   }
 
   if (argc - optind > 1)
-    error("too many arguments");
+    return Status::error("too many arguments");
 
-  file_name = (argc - optind == 0) ? "-" : argv[optind];
-  if (file_name == "-")
-    in_file = stdin;
-  else {
-    in_file = fopen(file_name.c_str(), "r");
-    if (!in_file)
-      error("could not open file for reading '" + file_name +
-            "': " + strerror(errno));
+  if (argc - optind == 1)
+    in_file_name = argv[optind];
+
+  Status stat = open_files(cwd);
+  if (!stat)
+    return stat;
+
+  // input and output not in files are sent over the socket
+  if (out_file == stdout) {
+    FILE *strm = open_record_stream(fd);
+    if (!strm)
+      return Status::error("could not write output to socket");
+    out_file = strm;
+  }
+  if (in_file == stdin) {
+    FILE *strm = fdopen(dup(fd), "r");
+    if (!strm)
+      return Status::error("could not read input from socket");
+    in_file = strm;
+    if (!(stat = send_record(fd, rec_ready)))
+      return stat;
   }
+
+  return Status::ok();
 }
 
 int main(int argc, char *argv[])
 {
   CavaFilter cava;
   cava.process_command_line(argc, argv);
-  cava.print_status_or_exit(cava.generate_spectrum_file());
+  if (cava.is_server())
+    cava.print_status_or_exit(cava.run_server());
+  else
+    cava.print_status_or_exit(cava.generate_spectrum_file());
 
   return 0;
 }
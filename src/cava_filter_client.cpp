@@ -0,0 +1,160 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+#include "cava_socket.hpp"
+#include "programopts.hpp"
+#include "utils.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+class CavaFilterClient : public ProgramOpts {
+private:
+  std::string socket_path;
+  std::vector<std::string> job_args;
+
+  static void send_input(int fd);
+
+public:
+  CavaFilterClient() : ProgramOpts("cava_filter_client") {}
+  void process_command_line(int argc, char **argv);
+  void usage();
+  Status run_job();
+};
+
+void CavaFilterClient::usage()
+{
+  fprintf(stdout, R"(
+Usage: %s [options] -s socket [-- job_options] [input_file]
+
+Run a cava_filter job on a cava_filter server (started with cava_filter -D).
+The job options and input_file are the same as for cava_filter. Input that
+is not read from a file is sent from standard input, and output that is
+not written to a file is written to standard output. Relative file names are
+relative to the current directory.
+
+  Options
+%s
+  -s <sock>  UNIX socket the server is listening on
+
+  )",
+          get_program_name().c_str(), help_ver_text);
+}
+
+void CavaFilterClient::process_command_line(int argc, char **argv)
+{
+  opterr = 0;
+  int c;
+
+  handle_long_opts(argc, argv);
+
+  while ((c = getopt(argc, argv, ":hs:")) != -1) {
+    if (common_opts(c, optopt))
+      continue;
+
+    switch (c) {
+    case 's':
+      socket_path = optarg;
+      break;
+
+    default:
+      error("unknown command line error");
+    }
+  }
+
+  if (socket_path.empty())
+    error("socket not given", 's');
+
+  job_args.assign(argv + optind, argv + argc);
+}
+
+void CavaFilterClient::send_input(int fd)
+{
+  std::vector<char> buf(1 << 16);
+  size_t num;
+  while ((num = fread(buf.data(), 1, buf.size(), stdin)) > 0)
+    if (!write_all(fd, buf.data(), num))
+      break;
+  shutdown(fd, SHUT_WR);
+}
+
+Status CavaFilterClient::run_job()
+{
+  // the job may finish before all of the input has been sent
+  signal(SIGPIPE, SIG_IGN);
+
+  char cwd[PATH_MAX];
+  if (!getcwd(cwd, sizeof(cwd)))
+    return Status::error(std::string("getting current directory: ") +
+                         strerror(errno));
+
+  int fd;
+  Status stat = socket_connect(socket_path, &fd);
+  if (!stat)
+    return stat;
+
+  if (!(stat = send_request(fd, cwd, job_args))) {
+    close(fd);
+    return stat;
+  }
+
+  std::string data;
+  char type;
+  while ((stat = receive_record(fd, &type, &data))) {
+    if (type == rec_ready) {
+      // input is sent while output is received
+      std::thread(send_input, fd).detach();
+    }
+    else if (type == rec_data)
+      fwrite(data.data(), 1, data.size(), stdout);
+    else {
+      fflush(stdout);
+      if (type == rec_error)
+        stat = Status::error(data);
+      else if (type == rec_warning)
+        stat = Status::warning(data);
+      else
+        stat = Status::ok(data);
+      break;
+    }
+  }
+
+  close(fd);
+  return stat;
+}
+
+int main(int argc, char *argv[])
+{
+  CavaFilterClient client;
+  client.process_command_line(argc, argv);
+  client.print_status_or_exit(client.run_job());
+
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file cava_filter_merge.cpp
+   \brief join the outputs of cava_filter chunks
+*/
+
+#include "programopts.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+class CavaFilterMerge : public ProgramOpts {
+private:
+  std::vector<std::string> chunk_file_names;
+  std::string out_file_name = "-";
+  std::string compare_file_name;
+  bool has_header = false;
+
+public:
+  CavaFilterMerge() : ProgramOpts("cava_filter_merge") {}
+  void process_command_line(int argc, char **argv);
+  void usage();
+  Status merge();
+};
+
+void CavaFilterMerge::usage()
+{
+  fprintf(stdout, R"(
+Usage: %s [options] chunk_file...
+
+Join the outputs of cava_filter chunks (cava_filter -x) in the order given,
+e.g. chunk 0 to chunk n-1 of the same input with the same options.
+
+  Options
+%s
+  -F         the chunk files start with a line of frequency bands (from
+             cava_filter -F), write it only once
+  -c <file>  compare the joined chunks with file, the output of cava_filter
+             for the whole input with the same options, and print statistics
+             of the differences instead of the joined chunks. Use this to
+             choose a warm-up time (cava_filter -w) for the chunks
+  -o <file>  write output to file (default: write to standard output)
+
+  )",
+          get_program_name().c_str(), help_ver_text);
+}
+
+void CavaFilterMerge::process_command_line(int argc, char **argv)
+{
+  opterr = 0;
+  int c;
+
+  handle_long_opts(argc, argv);
+
+  while ((c = getopt(argc, argv, ":hFc:o:")) != -1) {
+    if (common_opts(c, optopt))
+      continue;
+
+    switch (c) {
+    case 'F':
+      has_header = true;
+      break;
+
+    case 'c':
+      compare_file_name = optarg;
+      break;
+
+    case 'o':
+      out_file_name = optarg;
+      break;
+
+    default:
+      error("unknown command line error");
+    }
+  }
+
+  if (optind == argc)
+    error("no chunk files given");
+
+  chunk_file_names.assign(argv + optind, argv + argc);
+}
+
+namespace {
+// read a line, without the newline, return false at the end of the file
+bool read_line(FILE *file, std::string *line)
+{
+  line->clear();
+  int c;
+  while ((c = fgetc(file)) != EOF && c != '\n')
+    line->push_back(c);
+  return c != EOF || !line->empty();
+}
+
+// read the bar values of a line
+std::vector<int> read_bars(const std::string &line)
+{
+  std::vector<int> bars;
+  const char *p = line.c_str();
+  char *end;
+  while (true) {
+    long val = strtol(p, &end, 10);
+    if (end == p)
+      break;
+    bars.push_back(val);
+    p = end;
+  }
+  return bars;
+}
+
+// statistics of the differences between chunk and reference frames
+struct FrameDiffs {
+  size_t frames = 0;
+  size_t frames_differing = 0;
+  size_t bars = 0;
+  int max_diff = 0;
+  double sum_diff = 0;
+  long missing_frames = 0; // frames in reference but not chunks, or -extra
+
+  void add(const std::string &line, const std::string &ref_line)
+  {
+    auto line_bars = read_bars(line);
+    auto ref_bars = read_bars(ref_line);
+    bool differs = line_bars.size() != ref_bars.size();
+    for (size_t i = 0; i < std::min(line_bars.size(), ref_bars.size()); i++) {
+      int diff = abs(line_bars[i] - ref_bars[i]);
+      max_diff = std::max(max_diff, diff);
+      sum_diff += diff;
+      differs |= diff != 0;
+    }
+    bars += ref_bars.size();
+    frames++;
+    frames_differing += differs;
+  }
+
+  void print(FILE *out) const
+  {
+    fprintf(out, "frames:           %zu\n", frames);
+    fprintf(out, "frames differing: %zu (%.3f%%)\n", frames_differing,
+            frames ? 100.0 * frames_differing / frames : 0.0);
+    fprintf(out, "max bar diff:     %d\n", max_diff);
+    fprintf(out, "mean bar diff:    %.6f\n", bars ? sum_diff / bars : 0.0);
+    if (missing_frames > 0)
+      fprintf(out, "missing frames:   %ld\n", missing_frames);
+    else if (missing_frames < 0)
+      fprintf(out, "extra frames:     %ld\n", -missing_frames);
+  }
+};
+
+}; // namespace
+
+Status CavaFilterMerge::merge()
+{
+  FILE *out = stdout;
+  if (out_file_name != "-") {
+    out = fopen(out_file_name.c_str(), "w");
+    if (!out)
+      return Status::error("could not open file for writing '" +
+                           out_file_name + "': " + strerror(errno));
+  }
+
+  FILE *ref = nullptr;
+  if (!compare_file_name.empty()) {
+    ref = fopen(compare_file_name.c_str(), "r");
+    if (!ref)
+      return Status::error("could not open file for reading '" +
+                           compare_file_name + "': " + strerror(errno));
+  }
+
+  Status stat;
+  FrameDiffs diffs;
+  std::string line;
+  std::string ref_line;
+  for (size_t i = 0; i < chunk_file_names.size() && stat.is_ok(); i++) {
+    const auto &name = chunk_file_names[i];
+    FILE *chunk = fopen(name.c_str(), "r");
+    if (!chunk) {
+      stat.set_error("could not open file for reading '" + name +
+                     "': " + strerror(errno));
+      break;
+    }
+
+    bool at_start = true;
+    while (read_line(chunk, &line)) {
+      bool is_header = has_header && at_start;
+      at_start = false;
+      if (is_header && i > 0)
+        continue; // only the first header is kept
+
+      if (!ref)
+        fprintf(out, "%s\n", line.c_str());
+      else if (!read_line(ref, &ref_line))
+        diffs.missing_frames--;
+      else if (is_header) {
+        if (line != ref_line)
+          stat.set_error("frequency bands do not match '" +
+                         compare_file_name + "'");
+      }
+      else
+        diffs.add(line, ref_line);
+    }
+
+    if (ferror(chunk))
+      stat.set_error("reading '" + name + "': " + strerror(errno));
+    fclose(chunk);
+  }
+
+  if (ref) {
+    while (stat.is_ok() && read_line(ref, &ref_line))
+      diffs.missing_frames++;
+    fclose(ref);
+    if (stat.is_ok())
+      diffs.print(out);
+  }
+
+  if (out != stdout)
+    fclose(out);
+
+  return stat;
+}
+
+int main(int argc, char *argv[])
+{
+  CavaFilterMerge merge;
+  merge.process_command_line(argc, argv);
+  merge.print_status_or_exit(merge.merge());
+
+  return 0;
+}
@@ -0,0 +1,180 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file cava_filter_seek.cpp
+   \brief find frames of a cava_filter output from its index
+*/
+
+#include "frame_index.hpp"
+#include "programopts.hpp"
+#include "utils.hpp"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+class CavaFilterSeek : public ProgramOpts {
+private:
+  std::string index_file_name;
+  std::string output_file_name;
+  double time = -1;  // seconds into the input
+  double frame = -1; // output frame number
+  int num_lines = 1;
+
+public:
+  CavaFilterSeek() : ProgramOpts("cava_filter_seek") {}
+  void process_command_line(int argc, char **argv);
+  void usage();
+  Status seek();
+};
+
+void CavaFilterSeek::usage()
+{
+  fprintf(stdout, R"(
+Usage: %s [options] index_file [output_file]
+
+Find a frame in the output of cava_filter, using the index written with
+cava_filter -I. Print the frame lines from output_file if it is given,
+otherwise print the frame number and output offset of the index entry at
+or before the frame.
+
+  Options
+%s
+  -t <secs>  time of the frame, in seconds from the start of the input
+  -n <num>   number of the frame, counting from 0 for the first output frame
+             (default: 0)
+  -l <num>   number of frame lines to print from output_file (default: 1)
+
+  )",
+          get_program_name().c_str(), help_ver_text);
+}
+
+void CavaFilterSeek::process_command_line(int argc, char **argv)
+{
+  opterr = 0;
+  int c;
+
+  handle_long_opts(argc, argv);
+
+  while ((c = getopt(argc, argv, ":ht:n:l:")) != -1) {
+    if (common_opts(c, optopt))
+      continue;
+
+    switch (c) {
+    case 't':
+      print_status_or_exit(read_double(optarg, &time), c);
+      if (time < 0)
+        error("time cannot be negative", c);
+      break;
+
+    case 'n':
+      print_status_or_exit(read_double(optarg, &frame), c);
+      if (frame < 0 || frame != floor(frame))
+        error("frame number must be a non-negative integer", c);
+      break;
+
+    case 'l':
+      print_status_or_exit(read_int(optarg, &num_lines), c);
+      if (num_lines < 1)
+        error("number of lines must be greater than 0", c);
+      break;
+
+    default:
+      error("unknown command line error");
+    }
+  }
+
+  if (time >= 0 && frame >= 0)
+    error("cannot give both a time and a frame number");
+
+  if (argc - optind < 1)
+    error("index file not given");
+  if (argc - optind > 2)
+    error("too many arguments");
+
+  index_file_name = argv[optind];
+  if (argc - optind == 2)
+    output_file_name = argv[optind + 1];
+}
+
+Status CavaFilterSeek::seek()
+{
+  FrameIndexReader index;
+  Status stat = index.open(index_file_name);
+  if (!stat)
+    return stat;
+
+  uint64_t target = 0;
+  if (time >= 0) {
+    // frame numbers in the index start at the first output frame
+    double input_frame = floor(time * index.get_framerate());
+    if (input_frame < index.get_first_frame())
+      return Status::error("time is before the start of the output");
+    target = input_frame - index.get_first_frame();
+  }
+  else if (frame >= 0)
+    target = frame;
+
+  uint64_t entry_frame;
+  uint64_t offset;
+  if (!(stat = index.find(target, &entry_frame, &offset)))
+    return stat;
+
+  if (output_file_name.empty()) {
+    printf("%llu %llu\n", (unsigned long long)entry_frame,
+           (unsigned long long)offset);
+    return Status::ok();
+  }
+
+  FILE *out = fopen(output_file_name.c_str(), "r");
+  if (!out)
+    return Status::error("could not open file for reading '" +
+                         output_file_name + "': " + strerror(errno));
+
+  // scan forward at most one interval of lines to the frame
+  if (fseeko(out, offset, SEEK_SET) != 0)
+    stat.set_error(std::string("seeking output: ") + strerror(errno));
+  int c = 0;
+  for (uint64_t f = entry_frame; stat && f < target && c != EOF; f++)
+    while ((c = fgetc(out)) != EOF && c != '\n')
+      ;
+  for (int i = 0; stat && i < num_lines && c != EOF; i++)
+    while ((c = fgetc(out)) != EOF && putchar(c) != '\n')
+      ;
+  if (ferror(out))
+    stat.set_error("reading '" + output_file_name + "': " + strerror(errno));
+  fclose(out);
+
+  return stat;
+}
+
+int main(int argc, char *argv[])
+{
+  CavaFilterSeek seek;
+  seek.process_command_line(argc, argv);
+  seek.print_status_or_exit(seek.seek());
+
+  return 0;
+}
@@ -0,0 +1,250 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file cava_plan.hpp
+   \brief owner of a cavacore plan
+*/
+
+#ifndef CAVA_PLAN_H
+#define CAVA_PLAN_H
+
+extern "C" {
+#include "cavacore/cavacore.h"
+}
+
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/// Parameters for cava_init, plans made with equal parameters are
+/// interchangeable
+struct CavaPlanParams {
+  int bars;               ///< number of bars per channel
+  int rate;               ///< input audio sample rate
+  int channels;           ///< input audio channels, 1 or 2
+  int autosens;           ///< cava autosens, 0 to disable
+  double noise_reduction; ///< 0.0: noisy 1.0: smooth
+  int low_cut_off;        ///< low cutoff frequency in Hz
+  int high_cut_off;       ///< high cutoff frequency in Hz
+
+  /// Check the parameters are valid for a plan
+  /**\return status, evaluates to \c true if a plan can be initialised
+   *  with the parameters, otherwise \c false.*/
+  Status check() const
+  {
+    char msg[256];
+    if (cava_check_params(bars, rate, channels, low_cut_off, high_cut_off,
+                          msg, sizeof(msg)))
+      return Status::error(msg);
+    return Status::ok();
+  }
+
+  bool operator<(const CavaPlanParams &other) const
+  {
+    return std::tie(bars, rate, channels, autosens, noise_reduction,
+                    low_cut_off, high_cut_off) <
+           std::tie(other.bars, other.rate, other.channels, other.autosens,
+                    other.noise_reduction, other.low_cut_off,
+                    other.high_cut_off);
+  }
+};
+
+/// Owner of a cavacore plan
+/** The plan is destroyed with its owner. Ownership can be moved but not
+ *  copied, so plans can be held in containers, and a moved-from owner is
+ *  empty. Samples are passed as a pointer and length, and may be int16_t,
+ *  float or double. */
+class CavaPlan {
+private:
+  cava_plan *plan = nullptr;
+  std::vector<double> cava_in; // conversion buffer for non-double samples
+
+  template <typename T>
+  void convert_and_execute(const T *samples, size_t num, double *cava_out)
+  {
+    if (cava_in.size() < num)
+      cava_in.resize(num);
+    for (size_t i = 0; i < num; i++)
+      cava_in[i] = samples[i];
+    cava_execute(cava_in.data(), num, cava_out, plan);
+  }
+
+public:
+  /// Constructor, an empty owner
+  CavaPlan() noexcept = default;
+
+  /// Constructor, take ownership of a plan returned by cava_init
+  /**\param cava_plan the plan. */
+  explicit CavaPlan(cava_plan *cava_plan) noexcept : plan(cava_plan) {}
+
+  CavaPlan(const CavaPlan &) = delete;
+  CavaPlan &operator=(const CavaPlan &) = delete;
+
+  /// Move constructor
+  /**\param other the owner to take the plan from, left empty. */
+  CavaPlan(CavaPlan &&other) noexcept
+      : plan(other.plan), cava_in(std::move(other.cava_in))
+  {
+    other.plan = nullptr;
+  }
+
+  /// Move assignment, destroys any plan currently owned
+  /**\param other the owner to take the plan from, left empty.
+   * \return A reference to this owner. */
+  CavaPlan &operator=(CavaPlan &&other) noexcept
+  {
+    if (this != &other) {
+      destroy();
+      plan = other.plan;
+      other.plan = nullptr;
+      cava_in = std::move(other.cava_in);
+    }
+    return *this;
+  }
+
+  /// Destructor
+  ~CavaPlan() { destroy(); }
+
+  /// Initialise a plan, destroying any plan currently owned
+  /** The parameters are checked first, and on an error the owner is left
+   *  empty.
+   * \param params the plan parameters.
+   * \return status, evaluates to \c true if the plan was initialised,
+   *  otherwise \c false.*/
+  Status init(const CavaPlanParams &params)
+  {
+    destroy();
+    Status stat = params.check();
+    if (!stat)
+      return stat;
+    plan = cava_init(params.bars, params.rate, params.channels,
+                     params.autosens, params.noise_reduction,
+                     params.low_cut_off, params.high_cut_off);
+    return Status::ok();
+  }
+
+  /// Destroy the plan, leaving the owner empty
+  void destroy() noexcept
+  {
+    if (plan) {
+      cava_destroy(plan);
+      free(plan);
+      plan = nullptr;
+    }
+  }
+
+  /// Give up ownership of the plan
+  /**\return The plan, which the caller must destroy and free. */
+  cava_plan *release() noexcept
+  {
+    cava_plan *ret = plan;
+    plan = nullptr;
+    return ret;
+  }
+
+  /// Get the plan
+  /**\return The plan, or \c nullptr if the owner is empty. */
+  cava_plan *get() const noexcept { return plan; }
+
+  /// Check if there is a plan
+  /**\return \c true if there is a plan, otherwise \c false. */
+  explicit operator bool() const noexcept { return plan != nullptr; }
+
+  /// Reset the plan to the state of a newly initialised plan
+  void reset_state() { cava_reset(plan); }
+
+  /// Set the number of executions per second used by the smoothing
+  /** The smoothing then uses this rate rather than estimating it from the
+   *  number of samples in each execution, so it does not depend on the
+   *  sizes of earlier executions. reset_state() restores the estimate.
+   * \param exec_rate the executions per second, or \c 0 to estimate the
+   *  rate. */
+  void set_exec_rate(double exec_rate)
+  {
+    cava_set_exec_rate(plan, exec_rate);
+  }
+
+  /// Get the size of the state saved by save_state()
+  /**\return The size in bytes. */
+  size_t get_state_size() const { return cava_state_size(plan); }
+
+  /// Save the state that changes during execution
+  /**\param buf buffer to hold the state, of get_state_size() bytes. */
+  void save_state(void *buf) const { cava_save_state(plan, buf); }
+
+  /// Restore a state saved by save_state()
+  /** The state must be saved from a plan with the same parameters.
+   * \param buf the saved state. */
+  void load_state(const void *buf) { cava_load_state(plan, buf); }
+
+  /// Get the total number of bar values output by an execution
+  /**\return The number of bars per channel multiplied by the channels. */
+  int get_bars_total() const
+  {
+    return plan->number_of_bars * plan->audio_channels;
+  }
+
+  /// Get the cut off frequencies of the bars
+  /**\return The lower cutoff frequency of each bar, followed by the
+   *  high cutoff of the last bar. */
+  const float *get_cut_off_frequencies() const
+  {
+    return plan->cut_off_frequency;
+  }
+
+  /// Execute the plan
+  /**\param samples interleaved samples, if there are two channels.
+   * \param num the number of samples.
+   * \param cava_out the output bar values, get_bars_total() values. */
+  void execute(const double *samples, size_t num, double *cava_out)
+  {
+    // cava_execute does not modify its input
+    cava_execute(const_cast<double *>(samples), num, cava_out, plan);
+  }
+
+  /// Execute the plan
+  /**\param samples interleaved samples, if there are two channels.
+   * \param num the number of samples.
+   * \param cava_out the output bar values, get_bars_total() values. */
+  void execute(const float *samples, size_t num, double *cava_out)
+  {
+    convert_and_execute(samples, num, cava_out);
+  }
+
+  /// Execute the plan
+  /**\param samples interleaved samples, if there are two channels.
+   * \param num the number of samples.
+   * \param cava_out the output bar values, get_bars_total() values. */
+  void execute(const int16_t *samples, size_t num, double *cava_out)
+  {
+    convert_and_execute(samples, num, cava_out);
+  }
+};
+
+#endif // CAVA_PLAN_H
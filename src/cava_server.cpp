@@ -0,0 +1,256 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file cava_server.cpp
+   \brief run cava_filter jobs received on a UNIX socket
+*/
+
+#include "cava_server.hpp"
+#include "cava_socket.hpp"
+#include "plan_memory.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <sched.h>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+
+namespace {
+// FFTW planning is not thread safe, only fftw_execute may run concurrently
+std::mutex planner_mutex;
+} // namespace
+
+CavaPlanPool::~CavaPlanPool()
+{
+  std::lock_guard<std::mutex> lock(planner_mutex);
+  idle_plans.clear();
+}
+
+int CavaPlanPool::get_node() const
+{
+  return numa_local ? PlanMemory::get_current_node() : 0;
+}
+
+void CavaPlanPool::set_max_idle(size_t per_params, size_t total)
+{
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  max_idle_per_params = per_params;
+  max_idle = total;
+}
+
+Status CavaPlanPool::acquire(const CavaPlanParams &params, CavaPlan *plan)
+{
+  // invalid parameters are not added to the idle plans
+  Status stat = params.check();
+  if (!stat)
+    return stat;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto it = idle_plans.find({get_node(), params});
+    if (it != idle_plans.end()) {
+      auto &plans = it->second.plans;
+      *plan = std::move(plans.back());
+      plans.pop_back();
+      num_idle--;
+      if (plans.empty())
+        idle_plans.erase(it);
+      return Status::ok();
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(planner_mutex);
+  return plan->init(params);
+}
+
+void CavaPlanPool::release(const CavaPlanParams &params, CavaPlan plan)
+{
+  plan.reset_state();
+  vector<CavaPlan> evicted;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    const PlanKey key(get_node(), params);
+    auto &idle = idle_plans[key];
+    idle.last_used = ++use_count;
+    if (idle.plans.size() < max_idle_per_params) {
+      idle.plans.push_back(std::move(plan));
+      num_idle++;
+    }
+    else
+      evicted.push_back(std::move(plan));
+    if (idle.plans.empty())
+      idle_plans.erase(key);
+
+    // destroy the plans of the least recently used parameters
+    while (num_idle > max_idle) {
+      auto lru = idle_plans.begin();
+      for (auto it = idle_plans.begin(); it != idle_plans.end(); ++it)
+        if (it->second.last_used < lru->second.last_used)
+          lru = it;
+      for (auto &lru_plan : lru->second.plans)
+        evicted.push_back(std::move(lru_plan));
+      num_idle -= lru->second.plans.size();
+      idle_plans.erase(lru);
+    }
+  }
+
+  if (!evicted.empty()) {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    evicted.clear();
+  }
+}
+
+Status CavaPlanPool::prewarm(const CavaPlanParams &params, int num)
+{
+  vector<CavaPlan> plans(num);
+  Status stat;
+  for (int i = 0; i < num && stat; i++)
+    stat = acquire(params, &plans[i]);
+  for (auto &plan : plans)
+    if (plan)
+      release(params, std::move(plan));
+  return stat;
+}
+
+Status CavaPlanPool::add(const CavaPlanParams &params)
+{
+  CavaPlan plan;
+  Status stat;
+  {
+    std::lock_guard<std::mutex> lock(planner_mutex);
+    stat = plan.init(params);
+  }
+  if (stat)
+    release(params, std::move(plan));
+  return stat;
+}
+
+void CavaServer::serve_connection(int fd)
+{
+  string cwd;
+  vector<string> args;
+  // jobs open files with the permissions of the server
+  Status stat;
+  if (!socket_peer_is_owner(fd))
+    stat.set_error("jobs may only be sent by the user running the server");
+  else
+    stat = receive_request(fd, &cwd, &args);
+  if (stat)
+    stat = handler(cwd, args, fd, plan_pool);
+  send_status_record(fd, stat);
+  close(fd);
+}
+
+void CavaServer::set_local_plans(bool local)
+{
+  local_plans = local;
+  plan_pool.set_numa_local(local);
+}
+
+Status CavaServer::prewarm(const CavaPlanParams &params)
+{
+  Status stat = params.check();
+  if (!stat)
+    return stat;
+  if (local_plans)
+    prewarm_params.push_back(params);
+  else
+    stat = plan_pool.prewarm(params, num_workers);
+  return stat;
+}
+
+void CavaServer::worker(int idx)
+{
+  if (local_plans) {
+    // run on the CPUs of one node, if there is more than one
+    auto node_cpus = PlanMemory::get_node_cpus();
+    cpu_set_t allowed;
+    if (node_cpus.size() > 1 &&
+        sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      for (int cpu : node_cpus[idx % node_cpus.size()])
+        if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+          CPU_SET(cpu, &cpu_set);
+      if (CPU_COUNT(&cpu_set))
+        sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+    }
+
+    PlanMemory::use_in_thread();
+    // the parameters were checked by prewarm()
+    for (const auto &params : prewarm_params)
+      plan_pool.add(params);
+  }
+
+  while (true) {
+    int fd;
+    {
+      std::unique_lock<std::mutex> lock(queue_mutex);
+      queue_cond.wait(lock, [this] { return !connections.empty(); });
+      fd = connections.front();
+      connections.pop_front();
+    }
+    serve_connection(fd);
+  }
+}
+
+Status CavaServer::run(const string &socket_path)
+{
+  // a client may disconnect before its job has finished
+  signal(SIGPIPE, SIG_IGN);
+
+  int listen_fd;
+  Status stat = socket_listen(socket_path, &listen_fd);
+  if (!stat)
+    return stat;
+
+  vector<std::thread> workers;
+  for (int i = 0; i < num_workers; i++)
+    workers.emplace_back(&CavaServer::worker, this, i);
+
+  while (true) {
+    int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      stat.set_error(string("accepting connection: ") + strerror(errno));
+      break;
+    }
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    connections.push_back(fd);
+    queue_cond.notify_one();
+  }
+
+  // workers never finish, exit from main with the error
+  for (auto &thrd : workers)
+    thrd.detach();
+  close(listen_fd);
+  return stat;
+}
@@ -0,0 +1,179 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file cava_server.hpp
+   \brief run cava_filter jobs received on a UNIX socket
+*/
+
+#ifndef CAVA_SERVER_H
+#define CAVA_SERVER_H
+
+#include "cava_plan.hpp"
+#include "status_msg.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A pool of initialised cava plans, kept warm between jobs
+/** Plans are created and destroyed with the FFTW planner lock held, so the
+ *  pool may be used from several threads. The number of idle plans is
+ *  limited for each set of parameters and in total, a plan released
+ *  beyond the limit for its parameters is destroyed, and beyond the total
+ *  limit the idle plans of the least recently used parameters are
+ *  destroyed first. */
+class CavaPlanPool {
+private:
+  typedef std::pair<int, CavaPlanParams> PlanKey; // NUMA node, parameters
+  struct IdlePlans {
+    std::vector<CavaPlan> plans;
+    uint64_t last_used = 0; // use count of the pool when last used
+  };
+
+  std::mutex pool_mutex;
+  std::map<PlanKey, IdlePlans> idle_plans;
+  size_t num_idle = 0;
+  uint64_t use_count = 0;
+  size_t max_idle_per_params = 8;
+  size_t max_idle = 32;
+  bool numa_local = false;
+
+  int get_node() const;
+
+public:
+  /// Set the limits on the number of idle plans
+  /** Plans beyond the limits are destroyed when they are released.
+   * \param per_params the maximum number of idle plans with the same
+   *  parameters, on the same NUMA node.
+   * \param total the maximum number of idle plans. */
+  void set_max_idle(size_t per_params, size_t total);
+
+  /// Keep the idle plans of each NUMA node separate
+  /** A plan is then only reused by a thread running on the node where
+   *  the plan was acquired, where its memory should be.
+   * \param local whether to keep the plans of each node separate. */
+  void set_numa_local(bool local) { numa_local = local; }
+
+  /// Destructor, destroys the idle plans
+  ~CavaPlanPool();
+
+  /// Get a plan, reusing an idle plan if there is one
+  /**\param params the plan parameters.
+   * \param plan used to return the plan, which behaves as a newly
+   *  initialised plan.
+   * \return status, evaluates to \c true if there is a plan, otherwise
+   *  \c false, if the parameters are not valid. */
+  Status acquire(const CavaPlanParams &params, CavaPlan *plan);
+
+  /// Return a plan to the pool
+  /** The plan is destroyed, or the least recently used idle plans are
+   *  destroyed, if there are too many idle plans.
+   * \param params the parameters the plan was acquired with.
+   * \param plan the plan. */
+  void release(const CavaPlanParams &params, CavaPlan plan);
+
+  /// Make sure a number of plans are ready for use
+  /**\param params the plan parameters.
+   * \param num the number of idle plans that should be available.
+   * \return status, evaluates to \c true if the plans are available,
+   *  otherwise \c false, if the parameters are not valid. */
+  Status prewarm(const CavaPlanParams &params, int num);
+
+  /// Initialise a new plan and add it to the idle plans
+  /**\param params the plan parameters.
+   * \return status, evaluates to \c true if the plan was added,
+   *  otherwise \c false, if the parameters are not valid. */
+  Status add(const CavaPlanParams &params);
+};
+
+/// Server that receives jobs on a UNIX socket and runs them on worker threads
+class CavaServer {
+public:
+  /// Job handler
+  /** Runs a job, the arguments are the working directory of the client,
+   *  the job arguments, the connected socket, and the plan pool. Output may
+   *  be sent in data records, and the returned status is sent to the
+   *  client by the server. */
+  typedef std::function<Status(const std::string &, std::vector<std::string> &,
+                               int, CavaPlanPool &)>
+      JobHandler;
+
+private:
+  JobHandler handler;
+  int num_workers;
+  CavaPlanPool plan_pool;
+  bool local_plans = false; // plans in huge pages on the node of the worker
+  std::vector<CavaPlanParams> prewarm_params;
+
+  std::mutex queue_mutex;
+  std::condition_variable queue_cond;
+  std::deque<int> connections;
+
+  void worker(int idx);
+  void serve_connection(int fd);
+
+public:
+  /// Constructor
+  /**\param job_handler the function that runs a job.
+   * \param workers the number of worker threads. */
+  CavaServer(JobHandler job_handler, int workers)
+      : handler(job_handler), num_workers(workers)
+  {
+    // a plan for each worker with the same parameters, and room for the
+    // plans of other recent jobs
+    plan_pool.set_max_idle(workers, 4 * workers);
+  }
+
+  /// Get the plan pool
+  /**\return The plan pool. */
+  CavaPlanPool &get_plan_pool() { return plan_pool; }
+
+  /// Allocate the plans of each worker from huge pages on its NUMA node
+  /** The workers are spread over the NUMA nodes, and each runs only on
+   *  the CPUs of its node, within the CPUs the server may run on. Plans
+   *  are allocated with PlanMemory, and are only reused on the node where
+   *  they were allocated. Call before run().
+   * \param local whether to allocate plans locally. */
+  void set_local_plans(bool local);
+
+  /// Make a plan ready for each worker
+  /** With local plans each worker makes its plan when it starts.
+   * \param params the plan parameters.
+   * \return status, evaluates to \c true if the parameters are valid,
+   *  otherwise \c false. */
+  Status prewarm(const CavaPlanParams &params);
+
+  /// Accept and run jobs
+  /**\param socket_path the path of the UNIX socket to listen on.
+   * \return status, only returns if there is an error. */
+  Status run(const std::string &socket_path);
+};
+
+#endif // CAVA_SERVER_H
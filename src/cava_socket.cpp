@@ -0,0 +1,248 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file cava_socket.cpp
+   \brief messages passed between the cava_filter server and its clients
+*/
+
+#include "cava_socket.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+Status make_address(const string &path, sockaddr_un *addr)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr->sun_path))
+    return Status::error("socket path is too long '" + path + "'");
+  strcpy(addr->sun_path, path.c_str());
+  return Status::ok();
+}
+
+Status read_all(int fd, void *buf, size_t len)
+{
+  char *p = static_cast<char *>(buf);
+  while (len > 0) {
+    ssize_t num = read(fd, p, len);
+    if (num < 0 && errno == EINTR)
+      continue;
+    if (num < 0)
+      return Status::error(string("reading socket: ") + strerror(errno));
+    if (num == 0)
+      return Status::error("reading socket: connection closed");
+    p += num;
+    len -= num;
+  }
+  return Status::ok();
+}
+
+ssize_t record_stream_write(void *cookie, const char *buf, size_t len)
+{
+  int fd = *static_cast<int *>(cookie);
+  if (!send_record(fd, rec_data, buf, len))
+    return -1;
+  return len;
+}
+
+int record_stream_close(void *cookie)
+{
+  delete static_cast<int *>(cookie);
+  return 0;
+}
+
+} // namespace
+
+Status write_all(int fd, const void *buf, size_t len)
+{
+  const char *p = static_cast<const char *>(buf);
+  while (len > 0) {
+    ssize_t num = write(fd, p, len);
+    if (num < 0 && errno == EINTR)
+      continue;
+    if (num < 0)
+      return Status::error(string("writing socket: ") + strerror(errno));
+    p += num;
+    len -= num;
+  }
+  return Status::ok();
+}
+
+Status socket_listen(const string &path, int *fd)
+{
+  sockaddr_un addr;
+  Status stat = make_address(path, &addr);
+  if (!stat)
+    return stat;
+
+  // only replace an old socket, not a file that happens to be at the path
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode))
+      return Status::error("'" + path + "' exists and is not a socket");
+    unlink(path.c_str());
+  }
+
+  *fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (*fd < 0)
+    return Status::error(string("creating socket: ") + strerror(errno));
+
+  // the socket is created with the permissions of the umask, make it
+  // accessible only by its owner from the start
+  mode_t old_mask = umask(0077);
+  int ret = bind(*fd, (sockaddr *)&addr, sizeof(addr));
+  umask(old_mask);
+  if (ret < 0 || listen(*fd, SOMAXCONN) < 0) {
+    stat.set_error("listening on socket '" + path + "': " + strerror(errno));
+    close(*fd);
+    *fd = -1;
+  }
+  return stat;
+}
+
+bool socket_peer_is_owner(int fd)
+{
+  ucred cred;
+  socklen_t len = sizeof(cred);
+  return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 &&
+         cred.uid == getuid();
+}
+
+Status socket_connect(const string &path, int *fd)
+{
+  sockaddr_un addr;
+  Status stat = make_address(path, &addr);
+  if (!stat)
+    return stat;
+
+  *fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (*fd < 0)
+    return Status::error(string("creating socket: ") + strerror(errno));
+
+  if (connect(*fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    stat.set_error("connecting to socket '" + path + "': " + strerror(errno));
+    close(*fd);
+    *fd = -1;
+  }
+  return stat;
+}
+
+Status send_request(int fd, const string &cwd, const vector<string> &args)
+{
+  string request = cwd + '\0';
+  for (const auto &arg : args)
+    request += arg + '\0';
+  request += '\0'; // empty string ends the request
+  return write_all(fd, request.data(), request.size());
+}
+
+Status receive_request(int fd, string *cwd, vector<string> *args)
+{
+  // Read a byte at a time, the client does not send anything else
+  // until it is asked for input
+  vector<string> strs;
+  string str;
+  size_t request_size = 0;
+  while (true) {
+    if (++request_size > max_request_size)
+      return Status::error("request is too long");
+    char c;
+    Status stat = read_all(fd, &c, 1);
+    if (!stat)
+      return stat;
+    if (c != '\0')
+      str += c;
+    else if (str.empty())
+      break;
+    else {
+      strs.push_back(str);
+      str.clear();
+    }
+  }
+
+  if (strs.empty())
+    return Status::error("request does not include a working directory");
+  *cwd = strs[0];
+  args->assign(strs.begin() + 1, strs.end());
+  return Status::ok();
+}
+
+Status send_record(int fd, char type, const char *data, size_t len)
+{
+  char header[1 + sizeof(uint32_t)];
+  header[0] = type;
+  uint32_t data_len = len;
+  memcpy(header + 1, &data_len, sizeof(data_len));
+  Status stat = write_all(fd, header, sizeof(header));
+  if (stat && len)
+    stat = write_all(fd, data, len);
+  return stat;
+}
+
+Status send_status_record(int fd, const Status &stat)
+{
+  char type = rec_ok;
+  if (stat.is_error())
+    type = rec_error;
+  else if (stat.is_warning())
+    type = rec_warning;
+  return send_record(fd, type, stat.msg().data(), stat.msg().size());
+}
+
+Status receive_record(int fd, char *type, string *data)
+{
+  char header[1 + sizeof(uint32_t)];
+  Status stat = read_all(fd, header, sizeof(header));
+  if (!stat)
+    return stat;
+
+  *type = header[0];
+  uint32_t data_len;
+  memcpy(&data_len, header + 1, sizeof(data_len));
+  data->resize(data_len);
+  if (data_len)
+    stat = read_all(fd, &(*data)[0], data_len);
+  return stat;
+}
+
+FILE *open_record_stream(int fd)
+{
+  cookie_io_functions_t funcs = {nullptr, record_stream_write, nullptr,
+                                 record_stream_close};
+  int *cookie = new int(fd);
+  FILE *strm = fopencookie(cookie, "w", funcs);
+  if (!strm)
+    delete cookie;
+  return strm;
+}
@@ -0,0 +1,136 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file cava_socket.hpp
+   \brief messages passed between the cava_filter server and its clients
+*/
+
+#ifndef CAVA_SOCKET_H
+#define CAVA_SOCKET_H
+
+#include "status_msg.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/// Record types in a server reply
+/** A reply is a sequence of records, each a type character followed by the
+ *  record data length (uint32_t) and the data. The final record is a status
+ *  record, which closes the reply. */
+enum {
+  rec_ready = 'R',   ///< the job reads its input from the socket, send it
+  rec_data = 'D',    ///< job output
+  rec_ok = 'S',      ///< status ok, with optional message
+  rec_warning = 'W', ///< status warning
+  rec_error = 'E'    ///< status error
+};
+
+/// The maximum length of a job request, in bytes
+const size_t max_request_size = 1 << 16;
+
+/// Create a socket listening on a UNIX socket path
+/** The socket may only be connected to by its owner.
+ * \param path the socket path, an existing socket at the path is removed,
+ *  and any other file is an error.
+ * \param fd used to return the listening socket file descriptor.
+ * \return status, evaluates to \c true if the socket is listening,
+ *  otherwise \c false.*/
+Status socket_listen(const std::string &path, int *fd);
+
+/// Check whether the peer of a connected socket has the user ID of this
+/// process
+/**\param fd the socket file descriptor.
+ * \return \c true if the peer has the same user ID, otherwise \c false. */
+bool socket_peer_is_owner(int fd);
+
+/// Connect to a UNIX socket path
+/**\param path the socket path.
+ * \param fd used to return the connected socket file descriptor.
+ * \return status, evaluates to \c true if the socket is connected,
+ *  otherwise \c false.*/
+Status socket_connect(const std::string &path, int *fd);
+
+/// Send a job request
+/** The request is the working directory followed by the job arguments,
+ *  each terminated by a null character, and ends with an empty string.
+ * \param fd the socket file descriptor.
+ * \param cwd the directory to resolve relative file names against.
+ * \param args the job arguments, as given on the cava_filter command line.
+ * \return status, evaluates to \c true if the request was sent,
+ *  otherwise \c false.*/
+Status send_request(int fd, const std::string &cwd,
+                    const std::vector<std::string> &args);
+
+/// Receive a job request
+/** A request longer than max_request_size is an error.
+ * \param fd the socket file descriptor.
+ * \param cwd used to return the directory to resolve relative file names
+ *  against.
+ * \param args used to return the job arguments.
+ * \return status, evaluates to \c true if a request was received,
+ *  otherwise \c false.*/
+Status receive_request(int fd, std::string *cwd,
+                       std::vector<std::string> *args);
+
+/// Send a reply record
+/**\param fd the socket file descriptor.
+ * \param type the record type.
+ * \param data the record data.
+ * \param len the length of the record data.
+ * \return status, evaluates to \c true if the record was sent,
+ *  otherwise \c false.*/
+Status send_record(int fd, char type, const char *data = nullptr,
+                   size_t len = 0);
+
+/// Send a status as the final reply record
+/**\param fd the socket file descriptor.
+ * \param stat the status to send.
+ * \return status, evaluates to \c true if the record was sent,
+ *  otherwise \c false.*/
+Status send_status_record(int fd, const Status &stat);
+
+/// Receive a reply record
+/**\param fd the socket file descriptor.
+ * \param type used to return the record type.
+ * \param data used to return the record data.
+ * \return status, evaluates to \c true if a record was received,
+ *  otherwise \c false.*/
+Status receive_record(int fd, char *type, std::string *data);
+
+/// Open a stream that sends everything written to it as data records
+/** Closing the stream does not close the socket.
+ * \param fd the socket file descriptor.
+ * \return The stream, or \c nullptr if it could not be opened. */
+FILE *open_record_stream(int fd);
+
+/// Write all of a buffer to a file descriptor
+/**\param fd the file descriptor.
+ * \param buf the data to write.
+ * \param len the length of the data.
+ * \return status, evaluates to \c true if all the data was written,
+ *  otherwise \c false.*/
+Status write_all(int fd, const void *buf, size_t len);
+
+#endif // CAVA_SOCKET_H
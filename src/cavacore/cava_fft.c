@@ -0,0 +1,265 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "cava_fft.h"
+#include <stdlib.h>
+
+#ifndef CAVA_BUILTIN_FFT
+
+#include <fftw3.h>
+
+struct cava_fft_plan_s {
+    fftw_plan plan;
+};
+
+double *cava_fft_alloc_real(size_t n) { return fftw_alloc_real(n); }
+
+cava_fft_complex *cava_fft_alloc_complex(size_t n) {
+    return (cava_fft_complex *)fftw_alloc_complex(n);
+}
+
+void cava_fft_free(void *buf) { fftw_free(buf); }
+
+cava_fft_plan cava_fft_plan_r2c(int n, double *in, cava_fft_complex *out) {
+    cava_fft_plan p = malloc(sizeof(struct cava_fft_plan_s));
+    p->plan = fftw_plan_dft_r2c_1d(n, in, (fftw_complex *)out, FFTW_MEASURE);
+    return p;
+}
+
+void cava_fft_execute(cava_fft_plan p) { fftw_execute(p->plan); }
+
+void cava_fft_destroy_plan(cava_fft_plan p) {
+    fftw_destroy_plan(p->plan);
+    free(p);
+}
+
+#else // CAVA_BUILTIN_FFT
+
+#include <math.h>
+#ifndef M_PI
+#define M_PI 3.1415926535897932385
+#endif
+
+// buffers are aligned for vector loads
+#define CAVA_FFT_ALIGN 64
+
+// a factor of the complex size for each stage, at most one per bit
+#define CAVA_FFT_MAX_STAGES 32
+
+// The real input of size n is treated as n / 2 complex values, which are
+// transformed with a mixed radix FFT (radix 4, 2 and any other prime), and the
+// result is then split into the transform of the real input
+struct cava_fft_plan_s {
+    int n;                        // real size
+    int m;                        // complex size, n / 2
+    double *in;                   // real input, read as m complex values
+    cava_fft_complex *out;        // output, m + 1 values
+    int stages[2 * CAVA_FFT_MAX_STAGES]; // radix, then remaining size, of each stage
+    cava_fft_complex *twiddles;   // exp(-2 pi i k / m), for k < m
+    cava_fft_complex *split;      // exp(-2 pi i k / n), for k < m
+    cava_fft_complex *buf;        // complex transform, m values
+    cava_fft_complex *scratch;    // one value for each input of a generic radix
+};
+
+double *cava_fft_alloc_real(size_t n) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, CAVA_FFT_ALIGN, n * sizeof(double)) != 0)
+        return NULL;
+    return buf;
+}
+
+cava_fft_complex *cava_fft_alloc_complex(size_t n) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, CAVA_FFT_ALIGN, n * sizeof(cava_fft_complex)) != 0)
+        return NULL;
+    return buf;
+}
+
+void cava_fft_free(void *buf) { free(buf); }
+
+// factors of m, with radix 4 first for the fewest stages, returns the largest radix
+static int factorize(int m, int *stages) {
+    int radix = 4;
+    int max_radix = 1;
+    do {
+        while (m % radix) {
+            if (radix == 4)
+                radix = 2;
+            else if (radix == 2)
+                radix = 3;
+            else
+                radix += 2;
+            if (radix * radix > m)
+                radix = m;
+        }
+        m /= radix;
+        *stages++ = radix;
+        *stages++ = m;
+        if (radix > max_radix)
+            max_radix = radix;
+    } while (m > 1);
+    return max_radix;
+}
+
+static void butterfly_2(const struct cava_fft_plan_s *p, cava_fft_complex *out, int stride,
+                        int m) {
+    for (int k = 0; k < m; k++) {
+        const double *tw = p->twiddles[k * stride];
+        double *a = out[k];
+        double *b = out[k + m];
+        double t_re = b[0] * tw[0] - b[1] * tw[1];
+        double t_im = b[0] * tw[1] + b[1] * tw[0];
+        b[0] = a[0] - t_re;
+        b[1] = a[1] - t_im;
+        a[0] += t_re;
+        a[1] += t_im;
+    }
+}
+
+static void butterfly_4(const struct cava_fft_plan_s *p, cava_fft_complex *out, int stride,
+                        int m) {
+    for (int k = 0; k < m; k++) {
+        const double *tw1 = p->twiddles[k * stride];
+        const double *tw2 = p->twiddles[2 * k * stride];
+        const double *tw3 = p->twiddles[3 * k * stride];
+        double *a0 = out[k];
+        double *a1 = out[k + m];
+        double *a2 = out[k + 2 * m];
+        double *a3 = out[k + 3 * m];
+
+        double s0_re = a1[0] * tw1[0] - a1[1] * tw1[1];
+        double s0_im = a1[0] * tw1[1] + a1[1] * tw1[0];
+        double s1_re = a2[0] * tw2[0] - a2[1] * tw2[1];
+        double s1_im = a2[0] * tw2[1] + a2[1] * tw2[0];
+        double s2_re = a3[0] * tw3[0] - a3[1] * tw3[1];
+        double s2_im = a3[0] * tw3[1] + a3[1] * tw3[0];
+
+        double s5_re = a0[0] - s1_re;
+        double s5_im = a0[1] - s1_im;
+        double s6_re = a0[0] + s1_re;
+        double s6_im = a0[1] + s1_im;
+        double s3_re = s0_re + s2_re;
+        double s3_im = s0_im + s2_im;
+        double s4_re = s0_re - s2_re;
+        double s4_im = s0_im - s2_im;
+
+        a0[0] = s6_re + s3_re;
+        a0[1] = s6_im + s3_im;
+        a2[0] = s6_re - s3_re;
+        a2[1] = s6_im - s3_im;
+        a1[0] = s5_re + s4_im;
+        a1[1] = s5_im - s4_re;
+        a3[0] = s5_re - s4_im;
+        a3[1] = s5_im + s4_re;
+    }
+}
+
+// any radix, as a direct DFT of the radix inputs
+static void butterfly_generic(const struct cava_fft_plan_s *p, cava_fft_complex *out,
+                              int stride, int m, int radix) {
+    cava_fft_complex *scratch = p->scratch;
+    for (int u = 0; u < m; u++) {
+        for (int q = 0; q < radix; q++) {
+            scratch[q][0] = out[u + q * m][0];
+            scratch[q][1] = out[u + q * m][1];
+        }
+        for (int q1 = 0; q1 < radix; q1++) {
+            int k = u + q1 * m;
+            int tw_idx = 0;
+            double sum_re = scratch[0][0];
+            double sum_im = scratch[0][1];
+            for (int q = 1; q < radix; q++) {
+                tw_idx += stride * k;
+                if (tw_idx >= p->m)
+                    tw_idx -= p->m;
+                const double *tw = p->twiddles[tw_idx];
+                sum_re += scratch[q][0] * tw[0] - scratch[q][1] * tw[1];
+                sum_im += scratch[q][0] * tw[1] + scratch[q][1] * tw[0];
+            }
+            out[k][0] = sum_re;
+            out[k][1] = sum_im;
+        }
+    }
+}
+
+// decimation in time, out holds the transform of the values of in at the stride
+static void transform(const struct cava_fft_plan_s *p, cava_fft_complex *out,
+                      const cava_fft_complex *in, int stride, const int *stages) {
+    int radix = stages[0];
+    int m = stages[1];
+
+    if (m == 1) {
+        for (int q = 0; q < radix; q++) {
+            out[q][0] = in[q * stride][0];
+            out[q][1] = in[q * stride][1];
+        }
+    } else {
+        for (int q = 0; q < radix; q++)
+            transform(p, out + q * m, in + q * stride, stride * radix, stages + 2);
+    }
+
+    if (radix == 2)
+        butterfly_2(p, out, stride, m);
+    else if (radix == 4)
+        butterfly_4(p, out, stride, m);
+    else
+        butterfly_generic(p, out, stride, m, radix);
+}
+
+cava_fft_plan cava_fft_plan_r2c(int n, double *in, cava_fft_complex *out) {
+    cava_fft_plan p = malloc(sizeof(struct cava_fft_plan_s));
+    p->n = n;
+    p->m = n / 2;
+    p->in = in;
+    p->out = out;
+    int max_radix = factorize(p->m, p->stages);
+
+    p->twiddles = cava_fft_alloc_complex(p->m);
+    p->split = cava_fft_alloc_complex(p->m);
+    p->buf = cava_fft_alloc_complex(p->m);
+    p->scratch = cava_fft_alloc_complex(max_radix);
+    for (int k = 0; k < p->m; k++) {
+        double phase = -2 * M_PI * k / p->m;
+        p->twiddles[k][0] = cos(phase);
+        p->twiddles[k][1] = sin(phase);
+        phase = -M_PI * k / p->m;
+        p->split[k][0] = cos(phase);
+        p->split[k][1] = sin(phase);
+    }
+
+    return p;
+}
+
+void cava_fft_execute(cava_fft_plan p) {
+    // pairs of real values are the real and imaginary parts of complex values
+    transform(p, p->buf, (const cava_fft_complex *)p->in, 1, p->stages);
+
+    // split into the transforms of the even and odd real values, and combine
+    const cava_fft_complex *z = p->buf;
+    cava_fft_complex *out = p->out;
+    int m = p->m;
+    out[0][0] = z[0][0] + z[0][1];
+    out[0][1] = 0;
+    out[m][0] = z[0][0] - z[0][1];
+    out[m][1] = 0;
+    for (int k = 1; k < m; k++) {
+        double even_re = (z[k][0] + z[m - k][0]) / 2;
+        double even_im = (z[k][1] - z[m - k][1]) / 2;
+        double odd_re = (z[k][1] + z[m - k][1]) / 2;
+        double odd_im = (z[m - k][0] - z[k][0]) / 2;
+        const double *w = p->split[k];
+        out[k][0] = even_re + odd_re * w[0] - odd_im * w[1];
+        out[k][1] = even_im + odd_re * w[1] + odd_im * w[0];
+    }
+}
+
+void cava_fft_destroy_plan(cava_fft_plan p) {
+    cava_fft_free(p->twiddles);
+    cava_fft_free(p->split);
+    cava_fft_free(p->buf);
+    cava_fft_free(p->scratch);
+    free(p);
+}
+
+#endif // CAVA_BUILTIN_FFT
@@ -0,0 +1,29 @@
+#pragma once
+#include <stddef.h>
+
+// cava_fft, the real to complex FFT used by cavacore. This is FFTW, or, when
+// built with CAVA_BUILTIN_FFT, a mixed radix FFT in cava_fft.c that needs no
+// library and has no planning step
+
+// complex value, real part then imaginary part, with the layout of fftw_complex
+typedef double cava_fft_complex[2];
+
+// plan for the FFT of one size between fixed input and output buffers
+typedef struct cava_fft_plan_s *cava_fft_plan;
+
+// cava_fft_alloc_real, cava_fft_alloc_complex, allocate aligned buffers of n values
+// for the FFT input and output, free them with cava_fft_free
+extern double *cava_fft_alloc_real(size_t n);
+extern cava_fft_complex *cava_fft_alloc_complex(size_t n);
+extern void cava_fft_free(void *buf);
+
+// cava_fft_plan_r2c, plans the FFT of n real values in, which must be even, to the
+// n / 2 + 1 non-negative frequency values in out, as fftw_plan_dft_r2c_1d
+extern cava_fft_plan cava_fft_plan_r2c(int n, double *in, cava_fft_complex *out);
+
+// cava_fft_execute, transforms the current input of the plan. Plans can be
+// executed concurrently
+extern void cava_fft_execute(cava_fft_plan plan);
+
+// cava_fft_destroy_plan, destroys the plan, but not its buffers
+extern void cava_fft_destroy_plan(cava_fft_plan plan);
@@ -2,30 +2,60 @@
 #ifndef M_PI
 #define M_PI 3.1415926535897932385
 #endif
-#include <fftw3.h>
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define CAVA_TREBLE_BUFFER_SIZE 1024
 
-struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels, int autosens,
-                            double noise_reduction, int low_cut_off, int high_cut_off) {
+// smoothing values below this are set to zero. During silence the integral
+// decays towards zero and would otherwise pass through the denormal range,
+// where arithmetic is very slow on x86
+#define CAVA_SMOOTHING_FLOOR 1e-200
 
-    // sanity checks:
-    if (channels < 1 || channels > 2) {
-        fprintf(stderr,
-                "cava_init called with illegal number of channels: %d, number of channels "
-                "supported are "
-                "1 and 2\n",
-                channels);
-        exit(1);
-    }
-    if (rate < 1 || rate > 384000) {
-        fprintf(stderr, "cava_init called with illegal sample rate: %d\n", rate);
-        exit(1);
-    }
+// gravity_mod is recalculated when the framerate estimate has changed by more than
+// this fraction since the last calculation. The estimate approaches the rate of the
+// executions in ever smaller steps, each of which would otherwise need a pow, and a
+// smaller change moves the falloff by less than 1e-8 of the peak of the bar
+#define CAVA_GRAVITY_TOLERANCE 1e-9
+
+// allocator for the plans initialized by this thread, see cava_set_allocator
+static __thread void *(*thread_alloc_fn)(size_t size) = NULL;
+static __thread void (*thread_free_fn)(void *ptr) = NULL;
+
+void cava_set_allocator(void *(*alloc_fn)(size_t size), void (*free_fn)(void *ptr)) {
+    thread_alloc_fn = alloc_fn;
+    thread_free_fn = free_fn;
+}
 
+static void *plan_alloc(struct cava_plan *p, size_t size) {
+    return p->alloc_fn ? p->alloc_fn(size) : malloc(size);
+}
+
+static void plan_free(struct cava_plan *p, void *ptr) {
+    if (p->free_fn)
+        p->free_fn(ptr);
+    else
+        free(ptr);
+}
+
+static double *plan_alloc_real(struct cava_plan *p, size_t n) {
+    return p->alloc_fn ? p->alloc_fn(n * sizeof(double)) : cava_fft_alloc_real(n);
+}
+
+static cava_fft_complex *plan_alloc_complex(struct cava_plan *p, size_t n) {
+    return p->alloc_fn ? p->alloc_fn(n * sizeof(cava_fft_complex)) : cava_fft_alloc_complex(n);
+}
+
+static void plan_free_fft(struct cava_plan *p, void *buf) {
+    if (p->free_fn)
+        p->free_fn(buf);
+    else
+        cava_fft_free(buf);
+}
+
+static int get_treble_buffer_size(unsigned int rate) {
     int treble_buffer_size = 128;
 
     if (rate > 8125 && rate <= 16250)
@@ -41,47 +71,93 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
     else if (rate > 300000)
         treble_buffer_size = 8096;
 
+    return treble_buffer_size;
+}
+
+int cava_check_params(int number_of_bars, unsigned int rate, int channels, int low_cut_off,
+                      int high_cut_off, char *msg, size_t msg_len) {
+
+    // sanity checks:
+    if (channels < 1 || channels > 2) {
+        snprintf(msg, msg_len,
+                 "cava_init called with illegal number of channels: %d, number of channels "
+                 "supported are "
+                 "1 and 2",
+                 channels);
+        return 1;
+    }
+    if (rate < 1 || rate > 384000) {
+        snprintf(msg, msg_len, "cava_init called with illegal sample rate: %d", rate);
+        return 1;
+    }
+
+    int treble_buffer_size = get_treble_buffer_size(rate);
+
     if (number_of_bars < 1) {
-        fprintf(stderr,
-                "cava_init called with illegal number of bars: %d, number of channels must be "
-                "positive integer\n",
-                number_of_bars);
-        exit(1);
+        snprintf(msg, msg_len,
+                 "cava_init called with illegal number of bars: %d, number of channels must be "
+                 "positive integer",
+                 number_of_bars);
+        return 1;
     }
 
     if (number_of_bars > treble_buffer_size / 2 + 1) {
-        fprintf(stderr,
-                "cava_init called with illegal number of bars: %d, for %d sample rate number of "
-                "bars can't be more than %d "
-                "positive integer\n",
-                number_of_bars, rate, treble_buffer_size / 2 + 1);
-        exit(1);
+        snprintf(msg, msg_len,
+                 "cava_init called with illegal number of bars: %d, for %d sample rate number of "
+                 "bars can't be more than %d "
+                 "positive integer",
+                 number_of_bars, rate, treble_buffer_size / 2 + 1);
+        return 1;
     }
     if (low_cut_off < 0 || high_cut_off < 0) {
-        fprintf(stderr, "low_cut_off must be a positive value\n");
-        exit(1);
+        snprintf(msg, msg_len, "low_cut_off must be a positive value");
+        return 1;
     }
     if (low_cut_off >= high_cut_off) {
-        fprintf(stderr, "high_cut_off must be a higher than low_cut_off\n");
-        exit(1);
+        snprintf(msg, msg_len, "high_cut_off must be a higher than low_cut_off");
+        return 1;
     }
     if ((unsigned int)high_cut_off > rate / 2) {
-        fprintf(stderr,
-                "high_cut_off can't be higher than sample rate / 2. (Nyquist Sampling Theorem)\n");
+        snprintf(msg, msg_len,
+                 "high_cut_off can't be higher than sample rate / 2. (Nyquist Sampling Theorem)");
+        return 1;
+    }
+
+    return 0;
+}
+
+struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels, int autosens,
+                            double noise_reduction, int low_cut_off, int high_cut_off) {
+
+    char msg[256];
+    if (cava_check_params(number_of_bars, rate, channels, low_cut_off, high_cut_off, msg,
+                          sizeof(msg))) {
+        fprintf(stderr, "%s\n", msg);
         exit(1);
     }
 
+    int treble_buffer_size = get_treble_buffer_size(rate);
+
     struct cava_plan *p = malloc(sizeof(struct cava_plan));
     p->number_of_bars = number_of_bars;
     p->audio_channels = channels;
     p->rate = rate;
     p->autosens = 1;
     p->sens = 1;
+    p->sens_init = 1;
     p->autosens = autosens;
-    p->framerate = 75;
+    p->framerate = CAVA_INITIAL_FRAMERATE;
+    p->fixed_exec_rate = 0;
     p->frame_skip = 1;
     p->average_max = 0;
     p->noise_reduction = noise_reduction;
+    p->exec_new_samples = 0;
+    p->exec_frame_skip = 0;
+    p->exec_framerate = 0;
+    p->gravity_framerate = 0;
+    p->gravity_mod = 1;
+    p->alloc_fn = thread_alloc_fn;
+    p->free_fn = thread_free_fn;
 
     p->g = log10((float)p->height) * 0.05;
 
@@ -91,22 +167,22 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
 
     p->input_buffer_size = p->FFTbassbufferSize * channels;
 
-    p->input_buffer = (double *)malloc(p->input_buffer_size * sizeof(double));
+    p->input_buffer = (double *)plan_alloc(p, p->input_buffer_size * sizeof(double));
 
-    p->FFTbuffer_lower_cut_off = (int *)malloc((number_of_bars + 1) * sizeof(int));
-    p->FFTbuffer_upper_cut_off = (int *)malloc((number_of_bars + 1) * sizeof(int));
-    p->eq = (double *)malloc((number_of_bars + 1) * sizeof(double));
-    p->cut_off_frequency = (float *)malloc((number_of_bars + 1) * sizeof(float));
+    p->FFTbuffer_lower_cut_off = (int *)plan_alloc(p, (number_of_bars + 1) * sizeof(int));
+    p->FFTbuffer_upper_cut_off = (int *)plan_alloc(p, (number_of_bars + 1) * sizeof(int));
+    p->eq = (double *)plan_alloc(p, (number_of_bars + 1) * sizeof(double));
+    p->cut_off_frequency = (float *)plan_alloc(p, (number_of_bars + 1) * sizeof(float));
 
-    p->cava_fall = (int *)malloc(number_of_bars * channels * sizeof(int));
-    p->cava_mem = (double *)malloc(number_of_bars * channels * sizeof(double));
-    p->cava_peak = (double *)malloc(number_of_bars * channels * sizeof(double));
-    p->prev_cava_out = (double *)malloc(number_of_bars * channels * sizeof(double));
+    p->cava_fall = (int *)plan_alloc(p, number_of_bars * channels * sizeof(int));
+    p->cava_mem = (double *)plan_alloc(p, number_of_bars * channels * sizeof(double));
+    p->cava_peak = (double *)plan_alloc(p, number_of_bars * channels * sizeof(double));
+    p->prev_cava_out = (double *)plan_alloc(p, number_of_bars * channels * sizeof(double));
 
     // Hann Window calculate multipliers
-    p->bass_multiplier = (double *)malloc(p->FFTbassbufferSize * sizeof(double));
-    p->mid_multiplier = (double *)malloc(p->FFTmidbufferSize * sizeof(double));
-    p->treble_multiplier = (double *)malloc(p->FFTtreblebufferSize * sizeof(double));
+    p->bass_multiplier = (double *)plan_alloc(p, p->FFTbassbufferSize * sizeof(double));
+    p->mid_multiplier = (double *)plan_alloc(p, p->FFTmidbufferSize * sizeof(double));
+    p->treble_multiplier = (double *)plan_alloc(p, p->FFTtreblebufferSize * sizeof(double));
     for (int i = 0; i < p->FFTbassbufferSize; i++) {
         p->bass_multiplier[i] = 0.5 * (1 - cos(2 * M_PI * i / (p->FFTbassbufferSize - 1)));
     }
@@ -118,66 +194,50 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
     }
 
     // BASS
-    p->in_bass_l = fftw_alloc_real(p->FFTbassbufferSize);
-    p->in_bass_l_raw = fftw_alloc_real(p->FFTbassbufferSize);
-    p->out_bass_l = fftw_alloc_complex(p->FFTbassbufferSize / 2 + 1);
-    p->p_bass_l =
-        fftw_plan_dft_r2c_1d(p->FFTbassbufferSize, p->in_bass_l, p->out_bass_l, FFTW_MEASURE);
+    p->in_bass_l = plan_alloc_real(p, p->FFTbassbufferSize);
+    p->out_bass_l = plan_alloc_complex(p, p->FFTbassbufferSize / 2 + 1);
+    p->p_bass_l = cava_fft_plan_r2c(p->FFTbassbufferSize, p->in_bass_l, p->out_bass_l);
 
     // MID
-    p->in_mid_l = fftw_alloc_real(p->FFTmidbufferSize);
-    p->in_mid_l_raw = fftw_alloc_real(p->FFTmidbufferSize);
-    p->out_mid_l = fftw_alloc_complex(p->FFTmidbufferSize / 2 + 1);
-    p->p_mid_l = fftw_plan_dft_r2c_1d(p->FFTmidbufferSize, p->in_mid_l, p->out_mid_l, FFTW_MEASURE);
+    p->in_mid_l = plan_alloc_real(p, p->FFTmidbufferSize);
+    p->out_mid_l = plan_alloc_complex(p, p->FFTmidbufferSize / 2 + 1);
+    p->p_mid_l = cava_fft_plan_r2c(p->FFTmidbufferSize, p->in_mid_l, p->out_mid_l);
 
     // TREBLE
-    p->in_treble_l = fftw_alloc_real(p->FFTtreblebufferSize);
-    p->in_treble_l_raw = fftw_alloc_real(p->FFTtreblebufferSize);
-    p->out_treble_l = fftw_alloc_complex(p->FFTtreblebufferSize / 2 + 1);
-    p->p_treble_l =
-        fftw_plan_dft_r2c_1d(p->FFTtreblebufferSize, p->in_treble_l, p->out_treble_l, FFTW_MEASURE);
+    p->in_treble_l = plan_alloc_real(p, p->FFTtreblebufferSize);
+    p->out_treble_l = plan_alloc_complex(p, p->FFTtreblebufferSize / 2 + 1);
+    p->p_treble_l = cava_fft_plan_r2c(p->FFTtreblebufferSize, p->in_treble_l, p->out_treble_l);
 
     memset(p->in_bass_l, 0, sizeof(double) * p->FFTbassbufferSize);
     memset(p->in_mid_l, 0, sizeof(double) * p->FFTmidbufferSize);
     memset(p->in_treble_l, 0, sizeof(double) * p->FFTtreblebufferSize);
-    memset(p->in_bass_l_raw, 0, sizeof(double) * p->FFTbassbufferSize);
-    memset(p->in_mid_l_raw, 0, sizeof(double) * p->FFTmidbufferSize);
-    memset(p->in_treble_l_raw, 0, sizeof(double) * p->FFTtreblebufferSize);
-    memset(p->out_bass_l, 0, (p->FFTbassbufferSize / 2 + 1) * sizeof(fftw_complex));
-    memset(p->out_mid_l, 0, (p->FFTmidbufferSize / 2 + 1) * sizeof(fftw_complex));
-    memset(p->out_treble_l, 0, (p->FFTtreblebufferSize / 2 + 1) * sizeof(fftw_complex));
+    memset(p->out_bass_l, 0, (p->FFTbassbufferSize / 2 + 1) * sizeof(cava_fft_complex));
+    memset(p->out_mid_l, 0, (p->FFTmidbufferSize / 2 + 1) * sizeof(cava_fft_complex));
+    memset(p->out_treble_l, 0, (p->FFTtreblebufferSize / 2 + 1) * sizeof(cava_fft_complex));
+    p->out_bass_r = p->out_mid_r = p->out_treble_r = NULL;
     if (p->audio_channels == 2) {
         // BASS
-        p->in_bass_r = fftw_alloc_real(p->FFTbassbufferSize);
-        p->in_bass_r_raw = fftw_alloc_real(p->FFTbassbufferSize);
-        p->out_bass_r = fftw_alloc_complex(p->FFTbassbufferSize / 2 + 1);
-        p->p_bass_r =
-            fftw_plan_dft_r2c_1d(p->FFTbassbufferSize, p->in_bass_r, p->out_bass_r, FFTW_MEASURE);
+        p->in_bass_r = plan_alloc_real(p, p->FFTbassbufferSize);
+        p->out_bass_r = plan_alloc_complex(p, p->FFTbassbufferSize / 2 + 1);
+        p->p_bass_r = cava_fft_plan_r2c(p->FFTbassbufferSize, p->in_bass_r, p->out_bass_r);
 
         // MID
-        p->in_mid_r = fftw_alloc_real(p->FFTmidbufferSize);
-        p->in_mid_r_raw = fftw_alloc_real(p->FFTmidbufferSize);
-        p->out_mid_r = fftw_alloc_complex(p->FFTmidbufferSize / 2 + 1);
-        p->p_mid_r =
-            fftw_plan_dft_r2c_1d(p->FFTmidbufferSize, p->in_mid_r, p->out_mid_r, FFTW_MEASURE);
+        p->in_mid_r = plan_alloc_real(p, p->FFTmidbufferSize);
+        p->out_mid_r = plan_alloc_complex(p, p->FFTmidbufferSize / 2 + 1);
+        p->p_mid_r = cava_fft_plan_r2c(p->FFTmidbufferSize, p->in_mid_r, p->out_mid_r);
 
         // TREBLE
-        p->in_treble_r = fftw_alloc_real(p->FFTtreblebufferSize);
-        p->in_treble_r_raw = fftw_alloc_real(p->FFTtreblebufferSize);
-        p->out_treble_r = fftw_alloc_complex(p->FFTtreblebufferSize / 2 + 1);
+        p->in_treble_r = plan_alloc_real(p, p->FFTtreblebufferSize);
+        p->out_treble_r = plan_alloc_complex(p, p->FFTtreblebufferSize / 2 + 1);
 
-        p->p_treble_r = fftw_plan_dft_r2c_1d(p->FFTtreblebufferSize, p->in_treble_r,
-                                             p->out_treble_r, FFTW_MEASURE);
+        p->p_treble_r = cava_fft_plan_r2c(p->FFTtreblebufferSize, p->in_treble_r, p->out_treble_r);
 
         memset(p->in_bass_r, 0, sizeof(double) * p->FFTbassbufferSize);
         memset(p->in_mid_r, 0, sizeof(double) * p->FFTmidbufferSize);
         memset(p->in_treble_r, 0, sizeof(double) * p->FFTtreblebufferSize);
-        memset(p->in_bass_r_raw, 0, sizeof(double) * p->FFTbassbufferSize);
-        memset(p->in_mid_r_raw, 0, sizeof(double) * p->FFTmidbufferSize);
-        memset(p->in_treble_r_raw, 0, sizeof(double) * p->FFTtreblebufferSize);
-        memset(p->out_bass_r, 0, (p->FFTbassbufferSize / 2 + 1) * sizeof(fftw_complex));
-        memset(p->out_mid_r, 0, (p->FFTmidbufferSize / 2 + 1) * sizeof(fftw_complex));
-        memset(p->out_treble_r, 0, (p->FFTtreblebufferSize / 2 + 1) * sizeof(fftw_complex));
+        memset(p->out_bass_r, 0, (p->FFTbassbufferSize / 2 + 1) * sizeof(cava_fft_complex));
+        memset(p->out_mid_r, 0, (p->FFTmidbufferSize / 2 + 1) * sizeof(cava_fft_complex));
+        memset(p->out_treble_r, 0, (p->FFTtreblebufferSize / 2 + 1) * sizeof(cava_fft_complex));
     }
 
     memset(p->input_buffer, 0, sizeof(double) * p->input_buffer_size);
@@ -205,6 +265,10 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
     int first_treble_bar = 0;
     int bar_buffer[p->number_of_bars + 1];
 
+    double log2_bass_size = log2(p->FFTbassbufferSize);
+    double log2_mid_size = log2(p->FFTmidbufferSize);
+    double log2_treble_size = log2(p->FFTtreblebufferSize);
+
     for (int n = 0; n < p->number_of_bars + 1; n++) {
         double bar_distribution_coefficient = frequency_constant * (-1);
         bar_distribution_coefficient +=
@@ -224,13 +288,13 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
         // and nyquist freq in M/2 but testing shows it is not...
         // or maybe the nq freq is in M/4
 
-        p->eq[n] = pow(p->cut_off_frequency[n], 1);
+        p->eq[n] = p->cut_off_frequency[n];
 
         // the numbers that come out of the FFT are verry high
         // the EQ is used to "normalize" them by dividing with this verry huge number
-        p->eq[n] /= pow(2, 20);
+        p->eq[n] /= 1 << 20;
 
-        p->eq[n] /= log2(p->FFTbassbufferSize);
+        p->eq[n] /= log2_bass_size;
 
         if (p->cut_off_frequency[n] < bass_cut_off) {
             // BASS
@@ -241,7 +305,7 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
             if (p->bass_cut_off_bar > 0)
                 first_bar = 0;
 
-            p->eq[n] *= log2(p->FFTbassbufferSize);
+            p->eq[n] *= log2_bass_size;
             if (p->FFTbuffer_lower_cut_off[n] > p->FFTbassbufferSize / 2) {
                 p->FFTbuffer_lower_cut_off[n] = p->FFTbassbufferSize / 2;
             }
@@ -261,7 +325,7 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
                 first_bar = 0;
             }
 
-            p->eq[n] *= log2(p->FFTmidbufferSize);
+            p->eq[n] *= log2_mid_size;
             if (p->FFTbuffer_lower_cut_off[n] > p->FFTmidbufferSize / 2) {
                 p->FFTbuffer_lower_cut_off[n] = p->FFTmidbufferSize / 2;
             }
@@ -280,7 +344,7 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
                 first_bar = 0;
             }
 
-            p->eq[n] *= log2(p->FFTtreblebufferSize);
+            p->eq[n] *= log2_treble_size;
             if (p->FFTbuffer_lower_cut_off[n] > p->FFTtreblebufferSize / 2) {
                 p->FFTbuffer_lower_cut_off[n] = p->FFTtreblebufferSize / 2;
             }
@@ -337,7 +401,9 @@ struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int channels,
     return p;
 }
 
-void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cava_plan *p) {
+// adds the new samples to the input buffer and updates the framerate estimate,
+// returns 1 if the new samples are all zero
+static int execute_input(double *cava_in, int new_samples, struct cava_plan *p) {
 
     // do not overflow
     if (new_samples > p->input_buffer_size) {
@@ -346,16 +412,26 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
 
     int silence = 1;
     if (new_samples > 0) {
-        p->framerate -= p->framerate / 64;
-        p->framerate += (double)((p->rate * p->audio_channels * p->frame_skip) / new_samples) / 64;
+        if (p->fixed_exec_rate > 0) {
+            p->framerate = p->fixed_exec_rate;
+        } else {
+            // the framerate of this exec only changes with new_samples and frame_skip
+            if (new_samples != p->exec_new_samples || p->frame_skip != p->exec_frame_skip) {
+                p->exec_new_samples = new_samples;
+                p->exec_frame_skip = p->frame_skip;
+                p->exec_framerate =
+                    (double)((p->rate * p->audio_channels * p->frame_skip) / new_samples);
+            }
+            p->framerate -= p->framerate / 64;
+            p->framerate += p->exec_framerate / 64;
+        }
         p->frame_skip = 1;
         // shifting input buffer
-        for (uint16_t n = p->input_buffer_size - 1; n >= new_samples; n--) {
-            p->input_buffer[n] = p->input_buffer[n - new_samples];
-        }
+        memmove(p->input_buffer + new_samples, p->input_buffer,
+                (p->input_buffer_size - new_samples) * sizeof(double));
 
         // fill the input buffer
-        for (uint16_t n = 0; n < new_samples; n++) {
+        for (int n = 0; n < new_samples; n++) {
             p->input_buffer[new_samples - n - 1] = cava_in[n];
             if (cava_in[n]) {
                 silence = 0;
@@ -365,59 +441,22 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
         p->frame_skip++;
     }
 
-    // fill the bass, mid and treble buffers
-    for (uint16_t n = 0; n < p->FFTbassbufferSize; n++) {
-        if (p->audio_channels == 2) {
-            p->in_bass_l_raw[n] = p->input_buffer[n * 2];
-            p->in_bass_r_raw[n] = p->input_buffer[n * 2 + 1];
-        } else {
-            p->in_bass_l_raw[n] = p->input_buffer[n];
-        }
-    }
-    for (uint16_t n = 0; n < p->FFTmidbufferSize; n++) {
-        if (p->audio_channels == 2) {
-            p->in_mid_l_raw[n] = p->input_buffer[n * 2];
-            p->in_mid_r_raw[n] = p->input_buffer[n * 2 + 1];
-        } else {
-            p->in_mid_l_raw[n] = p->input_buffer[n];
-        }
-    }
-    for (uint16_t n = 0; n < p->FFTtreblebufferSize; n++) {
-        if (p->audio_channels == 2) {
-            p->in_treble_l_raw[n] = p->input_buffer[n * 2];
-            p->in_treble_r_raw[n] = p->input_buffer[n * 2 + 1];
-        } else {
-            p->in_treble_l_raw[n] = p->input_buffer[n];
-        }
-    }
-
-    // Hann Window
-    for (int i = 0; i < p->FFTbassbufferSize; i++) {
-        p->in_bass_l[i] = p->bass_multiplier[i] * p->in_bass_l_raw[i];
-        if (p->audio_channels == 2)
-            p->in_bass_r[i] = p->bass_multiplier[i] * p->in_bass_r_raw[i];
-    }
-    for (int i = 0; i < p->FFTmidbufferSize; i++) {
-        p->in_mid_l[i] = p->mid_multiplier[i] * p->in_mid_l_raw[i];
-        if (p->audio_channels == 2)
-            p->in_mid_r[i] = p->mid_multiplier[i] * p->in_mid_r_raw[i];
-    }
-    for (int i = 0; i < p->FFTtreblebufferSize; i++) {
-        p->in_treble_l[i] = p->treble_multiplier[i] * p->in_treble_l_raw[i];
-        if (p->audio_channels == 2)
-            p->in_treble_r[i] = p->treble_multiplier[i] * p->in_treble_r_raw[i];
-    }
+    return silence;
+}
 
-    // process: execute FFT and sort frequency bands
+// Hann Window, of the first size samples of a channel of the input buffer
+static void window_channel(const struct cava_plan *p, int channel, const double *multiplier,
+                           int size, double *out) {
+    const double *in = p->input_buffer + channel;
+    int channels = p->audio_channels;
+    for (int i = 0; i < size; i++)
+        out[i] = multiplier[i] * in[i * channels];
+}
 
-    fftw_execute(p->p_bass_l);
-    fftw_execute(p->p_mid_l);
-    fftw_execute(p->p_treble_l);
-    if (p->audio_channels == 2) {
-        fftw_execute(p->p_bass_r);
-        fftw_execute(p->p_mid_r);
-        fftw_execute(p->p_treble_r);
-    }
+// separates the frequency bands from the FFT output of each channel, bass, mid
+// then treble, and applies the sensitivity and smoothing
+static void execute_bands(cava_fft_complex *const *outs_l, cava_fft_complex *const *outs_r,
+                          int silence, double *cava_out, struct cava_plan *p) {
 
     // process: separate frequency bands
     for (int n = 0; n < p->number_of_bars; n++) {
@@ -425,26 +464,22 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
         double temp_l = 0;
         double temp_r = 0;
 
+        int band = 2;
+        if (n <= p->bass_cut_off_bar)
+            band = 0;
+        else if (n <= p->treble_cut_off_bar)
+            band = 1;
+        const cava_fft_complex *out_l = outs_l[band];
+        const cava_fft_complex *out_r = outs_r[band];
+
         // process: add upp FFT values within bands
+        // the magnitudes cannot overflow, so sqrt is used rather than the slower hypot.
+        // The sums can differ from those with hypot in the last bits, the printed bars
+        // of cava_filter were the same for a 140 second test signal
         for (int i = p->FFTbuffer_lower_cut_off[n]; i <= p->FFTbuffer_upper_cut_off[n]; i++) {
-
-            if (n <= p->bass_cut_off_bar) {
-                temp_l += hypot(p->out_bass_l[i][0], p->out_bass_l[i][1]);
-                if (p->audio_channels == 2)
-                    temp_r += hypot(p->out_bass_r[i][0], p->out_bass_r[i][1]);
-
-            } else if (n > p->bass_cut_off_bar && n <= p->treble_cut_off_bar) {
-
-                temp_l += hypot(p->out_mid_l[i][0], p->out_mid_l[i][1]);
-                if (p->audio_channels == 2)
-                    temp_r += hypot(p->out_mid_r[i][0], p->out_mid_r[i][1]);
-
-            } else if (n > p->treble_cut_off_bar) {
-
-                temp_l += hypot(p->out_treble_l[i][0], p->out_treble_l[i][1]);
-                if (p->audio_channels == 2)
-                    temp_r += hypot(p->out_treble_r[i][0], p->out_treble_r[i][1]);
-            }
+            temp_l += sqrt(out_l[i][0] * out_l[i][0] + out_l[i][1] * out_l[i][1]);
+            if (p->audio_channels == 2)
+                temp_r += sqrt(out_r[i][0] * out_r[i][0] + out_r[i][1] * out_r[i][1]);
         }
 
         // getting average multiply with eq
@@ -472,10 +507,13 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
     }
     // process [smoothing]
     int overshoot = 0;
-    double gravity_mod = pow((60 / p->framerate), 2.5) * 1.54 / p->noise_reduction;
-
-    if (gravity_mod < 1)
-        gravity_mod = 1;
+    if (fabs(p->framerate - p->gravity_framerate) > CAVA_GRAVITY_TOLERANCE * p->framerate) {
+        p->gravity_framerate = p->framerate;
+        p->gravity_mod = pow((60 / p->framerate), 2.5) * 1.54 / p->noise_reduction;
+        if (p->gravity_mod < 1)
+            p->gravity_mod = 1;
+    }
+    double gravity_mod = p->gravity_mod;
 
     for (int n = 0; n < p->number_of_bars * p->audio_channels; n++) {
 
@@ -510,6 +548,8 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
             }
             cava_out[n] /= 1000;
         }
+        if (p->cava_mem[n] < CAVA_SMOOTHING_FLOOR)
+            p->cava_mem[n] = 0;
     }
 
     // calculating automatic sense adjustment
@@ -527,50 +567,178 @@ void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cav
     }
 }
 
+void cava_execute(double *cava_in, int new_samples, double *cava_out, struct cava_plan *p) {
+
+    int silence = execute_input(cava_in, new_samples, p);
+
+    window_channel(p, 0, p->bass_multiplier, p->FFTbassbufferSize, p->in_bass_l);
+    window_channel(p, 0, p->mid_multiplier, p->FFTmidbufferSize, p->in_mid_l);
+    window_channel(p, 0, p->treble_multiplier, p->FFTtreblebufferSize, p->in_treble_l);
+    if (p->audio_channels == 2) {
+        window_channel(p, 1, p->bass_multiplier, p->FFTbassbufferSize, p->in_bass_r);
+        window_channel(p, 1, p->mid_multiplier, p->FFTmidbufferSize, p->in_mid_r);
+        window_channel(p, 1, p->treble_multiplier, p->FFTtreblebufferSize, p->in_treble_r);
+    }
+
+    // process: execute FFT and sort frequency bands
+
+    cava_fft_execute(p->p_bass_l);
+    cava_fft_execute(p->p_mid_l);
+    cava_fft_execute(p->p_treble_l);
+    if (p->audio_channels == 2) {
+        cava_fft_execute(p->p_bass_r);
+        cava_fft_execute(p->p_mid_r);
+        cava_fft_execute(p->p_treble_r);
+    }
+
+    cava_fft_complex *outs_l[3] = {p->out_bass_l, p->out_mid_l, p->out_treble_l};
+    cava_fft_complex *outs_r[3] = {p->out_bass_r, p->out_mid_r, p->out_treble_r};
+    execute_bands(outs_l, outs_r, silence, cava_out, p);
+}
+
+void cava_set_exec_rate(struct cava_plan *p, double exec_rate) {
+    p->fixed_exec_rate = exec_rate > 0 ? exec_rate : 0;
+    if (p->fixed_exec_rate > 0)
+        p->framerate = p->fixed_exec_rate;
+}
+
+void cava_reset(struct cava_plan *p) {
+    p->sens = 1;
+    p->sens_init = 1;
+    p->framerate = CAVA_INITIAL_FRAMERATE;
+    p->fixed_exec_rate = 0;
+    p->frame_skip = 1;
+    p->average_max = 0;
+    p->exec_new_samples = 0;
+    p->exec_frame_skip = 0;
+    p->exec_framerate = 0;
+    p->gravity_framerate = 0;
+    p->gravity_mod = 1;
+
+    memset(p->input_buffer, 0, sizeof(double) * p->input_buffer_size);
+
+    memset(p->cava_fall, 0, sizeof(int) * p->number_of_bars * p->audio_channels);
+    memset(p->cava_mem, 0, sizeof(double) * p->number_of_bars * p->audio_channels);
+    memset(p->cava_peak, 0, sizeof(double) * p->number_of_bars * p->audio_channels);
+    memset(p->prev_cava_out, 0, sizeof(double) * p->number_of_bars * p->audio_channels);
+}
+
+size_t cava_state_size(struct cava_plan *p) {
+    int bars_total = p->number_of_bars * p->audio_channels;
+    return 6 * sizeof(double) + 4 * sizeof(int) + p->input_buffer_size * sizeof(double) +
+           bars_total * (3 * sizeof(double) + sizeof(int));
+}
+
+void cava_save_state(struct cava_plan *p, void *buf) {
+    int bars_total = p->number_of_bars * p->audio_channels;
+    char *pos = (char *)buf;
+
+    memcpy(pos, &p->sens, sizeof(double));
+    pos += sizeof(double);
+    memcpy(pos, &p->framerate, sizeof(double));
+    pos += sizeof(double);
+    memcpy(pos, &p->average_max, sizeof(double));
+    pos += sizeof(double);
+    memcpy(pos, &p->sens_init, sizeof(int));
+    pos += sizeof(int);
+    memcpy(pos, &p->frame_skip, sizeof(int));
+    pos += sizeof(int);
+    memcpy(pos, &p->exec_new_samples, sizeof(int));
+    pos += sizeof(int);
+    memcpy(pos, &p->exec_frame_skip, sizeof(int));
+    pos += sizeof(int);
+    memcpy(pos, &p->exec_framerate, sizeof(double));
+    pos += sizeof(double);
+    memcpy(pos, &p->gravity_framerate, sizeof(double));
+    pos += sizeof(double);
+    memcpy(pos, &p->gravity_mod, sizeof(double));
+    pos += sizeof(double);
+
+    memcpy(pos, p->input_buffer, p->input_buffer_size * sizeof(double));
+    pos += p->input_buffer_size * sizeof(double);
+    memcpy(pos, p->cava_mem, bars_total * sizeof(double));
+    pos += bars_total * sizeof(double);
+    memcpy(pos, p->cava_peak, bars_total * sizeof(double));
+    pos += bars_total * sizeof(double);
+    memcpy(pos, p->prev_cava_out, bars_total * sizeof(double));
+    pos += bars_total * sizeof(double);
+    memcpy(pos, p->cava_fall, bars_total * sizeof(int));
+}
+
+void cava_load_state(struct cava_plan *p, const void *buf) {
+    int bars_total = p->number_of_bars * p->audio_channels;
+    const char *pos = (const char *)buf;
+
+    memcpy(&p->sens, pos, sizeof(double));
+    pos += sizeof(double);
+    memcpy(&p->framerate, pos, sizeof(double));
+    pos += sizeof(double);
+    memcpy(&p->average_max, pos, sizeof(double));
+    pos += sizeof(double);
+    memcpy(&p->sens_init, pos, sizeof(int));
+    pos += sizeof(int);
+    memcpy(&p->frame_skip, pos, sizeof(int));
+    pos += sizeof(int);
+    memcpy(&p->exec_new_samples, pos, sizeof(int));
+    pos += sizeof(int);
+    memcpy(&p->exec_frame_skip, pos, sizeof(int));
+    pos += sizeof(int);
+    memcpy(&p->exec_framerate, pos, sizeof(double));
+    pos += sizeof(double);
+    memcpy(&p->gravity_framerate, pos, sizeof(double));
+    pos += sizeof(double);
+    memcpy(&p->gravity_mod, pos, sizeof(double));
+    pos += sizeof(double);
+
+    memcpy(p->input_buffer, pos, p->input_buffer_size * sizeof(double));
+    pos += p->input_buffer_size * sizeof(double);
+    memcpy(p->cava_mem, pos, bars_total * sizeof(double));
+    pos += bars_total * sizeof(double);
+    memcpy(p->cava_peak, pos, bars_total * sizeof(double));
+    pos += bars_total * sizeof(double);
+    memcpy(p->prev_cava_out, pos, bars_total * sizeof(double));
+    pos += bars_total * sizeof(double);
+    memcpy(p->cava_fall, pos, bars_total * sizeof(int));
+}
+
 void cava_destroy(struct cava_plan *p) {
 
-    fftw_free(p->in_bass_l);
-    fftw_free(p->in_bass_l_raw);
-    fftw_free(p->out_bass_l);
-    fftw_destroy_plan(p->p_bass_l);
+    plan_free_fft(p, p->in_bass_l);
+    plan_free_fft(p, p->out_bass_l);
+    cava_fft_destroy_plan(p->p_bass_l);
 
-    fftw_free(p->in_mid_l);
-    fftw_free(p->in_mid_l_raw);
-    fftw_free(p->out_mid_l);
-    fftw_destroy_plan(p->p_mid_l);
+    plan_free_fft(p, p->in_mid_l);
+    plan_free_fft(p, p->out_mid_l);
+    cava_fft_destroy_plan(p->p_mid_l);
 
-    fftw_free(p->in_treble_l);
-    fftw_free(p->in_treble_l_raw);
-    fftw_free(p->out_treble_l);
-    fftw_destroy_plan(p->p_treble_l);
+    plan_free_fft(p, p->in_treble_l);
+    plan_free_fft(p, p->out_treble_l);
+    cava_fft_destroy_plan(p->p_treble_l);
 
     if (p->audio_channels == 2) {
-        fftw_free(p->in_bass_r);
-        fftw_free(p->in_bass_r_raw);
-        fftw_free(p->out_bass_r);
-        fftw_destroy_plan(p->p_bass_r);
-
-        fftw_free(p->in_mid_r);
-        fftw_free(p->in_mid_r_raw);
-        fftw_free(p->out_mid_r);
-        fftw_destroy_plan(p->p_mid_r);
-
-        fftw_free(p->in_treble_r);
-        fftw_free(p->out_treble_r);
-        fftw_free(p->in_treble_r_raw);
-        fftw_destroy_plan(p->p_treble_r);
+        plan_free_fft(p, p->in_bass_r);
+        plan_free_fft(p, p->out_bass_r);
+        cava_fft_destroy_plan(p->p_bass_r);
+
+        plan_free_fft(p, p->in_mid_r);
+        plan_free_fft(p, p->out_mid_r);
+        cava_fft_destroy_plan(p->p_mid_r);
+
+        plan_free_fft(p, p->in_treble_r);
+        plan_free_fft(p, p->out_treble_r);
+        cava_fft_destroy_plan(p->p_treble_r);
     }
 
-    free(p->input_buffer);
-    free(p->bass_multiplier);
-    free(p->mid_multiplier);
-    free(p->treble_multiplier);
-    free(p->eq);
-    free(p->cut_off_frequency);
-    free(p->FFTbuffer_lower_cut_off);
-    free(p->FFTbuffer_upper_cut_off);
-    free(p->cava_fall);
-    free(p->cava_mem);
-    free(p->cava_peak);
-    free(p->prev_cava_out);
+    plan_free(p, p->input_buffer);
+    plan_free(p, p->bass_multiplier);
+    plan_free(p, p->mid_multiplier);
+    plan_free(p, p->treble_multiplier);
+    plan_free(p, p->eq);
+    plan_free(p, p->cut_off_frequency);
+    plan_free(p, p->FFTbuffer_lower_cut_off);
+    plan_free(p, p->FFTbuffer_upper_cut_off);
+    plan_free(p, p->cava_fall);
+    plan_free(p, p->cava_mem);
+    plan_free(p, p->cava_peak);
+    plan_free(p, p->prev_cava_out);
 }
\ No newline at end of file
@@ -1,7 +1,12 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
-#include <fftw3.h>
+#include "cava_fft.h"
+
+// the framerate estimate of a new or reset plan, the estimate then moves 1/64 of the
+// way to the rate of each execution
+#define CAVA_INITIAL_FRAMERATE 75
 
 // cava_plan, parameters used internally by cavacore, do not modify these directly
 // only the cut off frequencies is of any potential interest to read out,
@@ -24,24 +29,29 @@ struct cava_plan {
     double sens;
     double g;
     double framerate;
+    double fixed_exec_rate;
     double average_max;
     double noise_reduction;
 
-    fftw_plan p_bass_l, p_bass_r;
-    fftw_plan p_mid_l, p_mid_r;
-    fftw_plan p_treble_l, p_treble_r;
+    // per exec values, recalculated only when their inputs change
+    int exec_new_samples;
+    int exec_frame_skip;
+    double exec_framerate;
+    double gravity_framerate;
+    double gravity_mod;
+
+    cava_fft_plan p_bass_l, p_bass_r;
+    cava_fft_plan p_mid_l, p_mid_r;
+    cava_fft_plan p_treble_l, p_treble_r;
 
-    fftw_complex *out_bass_l, *out_bass_r;
-    fftw_complex *out_mid_l, *out_mid_r;
-    fftw_complex *out_treble_l, *out_treble_r;
+    cava_fft_complex *out_bass_l, *out_bass_r;
+    cava_fft_complex *out_mid_l, *out_mid_r;
+    cava_fft_complex *out_treble_l, *out_treble_r;
 
     double *bass_multiplier;
     double *mid_multiplier;
     double *treble_multiplier;
 
-    double *in_bass_r_raw, *in_bass_l_raw;
-    double *in_mid_r_raw, *in_mid_l_raw;
-    double *in_treble_r_raw, *in_treble_l_raw;
     double *in_bass_r, *in_bass_l;
     double *in_mid_r, *in_mid_l;
     double *in_treble_r, *in_treble_l;
@@ -54,8 +64,21 @@ struct cava_plan {
     int *FFTbuffer_lower_cut_off;
     int *FFTbuffer_upper_cut_off;
     int *cava_fall;
+
+    // allocator of the plan memory, NULL for malloc and free
+    void *(*alloc_fn)(size_t size);
+    void (*free_fn)(void *ptr);
 };
 
+// cava_set_allocator, sets the functions that allocate and free the buffers of the
+// plans that cava_init initializes afterwards in the calling thread, in place of
+// malloc and free, e.g. to allocate from huge pages local to the thread. Memory
+// returned by alloc_fn must be aligned to 64 bytes for the FFT. A plan keeps the
+// functions it was initialized with, and cava_destroy frees its buffers with free_fn,
+// from any thread. NULL for both restores malloc and free. The cava_plan struct itself
+// is always allocated with malloc
+extern void cava_set_allocator(void *(*alloc_fn)(size_t size), void (*free_fn)(void *ptr));
+
 // cava_init, initialize visualization, takes the following parameters:
 
 // number_of_bars, number of wanted bars per channel
@@ -83,6 +106,14 @@ extern struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int ch
                                    int autosens, double noise_reduction, int low_cut_off,
                                    int high_cut_off);
 
+// cava_check_params, checks the parameters that cava_init takes, without initializing
+// a plan. Returns 0 if cava_init would accept them, otherwise 1, with a description of
+// the first invalid parameter written to msg, which holds msg_len bytes. cava_init
+// prints the description and exits the process on invalid parameters, so a caller
+// that must keep running checks them first
+extern int cava_check_params(int number_of_bars, unsigned int rate, int channels,
+                             int low_cut_off, int high_cut_off, char *msg, size_t msg_len);
+
 // cava_execute, executes visualization
 
 // cava_in, input buffer can be any size. internal buffers in cavacore is
@@ -100,8 +131,37 @@ extern struct cava_plan *cava_init(int number_of_bars, unsigned int rate, int ch
 
 // cava_execute assumes cava_in samples to be interleaved if more than one channel
 // only up to two channels are supported.
+
+// the bar values can differ in the last bits from those of the cavacore of cava, as
+// the magnitudes of the FFT values are calculated with sqrt rather than hypot, and
+// the falloff is only updated for a change in the framerate estimate above 1e-9
 extern void cava_execute(double *cava_in, int new_samples, double *cava_out,
                          struct cava_plan *plan);
 
+// cava_set_exec_rate, sets the number of executions per second, which is then used
+// as the framerate of the smoothing instead of the estimate from the new_samples of
+// each execution. The smoothing then does not depend on the sizes of earlier
+// executions, and matches for any execution index however the plan got there.
+// exec_rate 0, or cava_reset, restores the estimate
+extern void cava_set_exec_rate(struct cava_plan *plan, double exec_rate);
+
+// cava_reset, clears the input buffer and smoothing state of the plan so that
+// it can be reused for a new input stream, the output will then be the same as
+// for a newly initialized plan with the same parameters
+extern void cava_reset(struct cava_plan *plan);
+
+// cava_state_size, returns the size in bytes of the state saved by cava_save_state
+
+// cava_save_state, copies the state that cava_execute changes (the input buffer, the
+// smoothing and sensitivity values, and the per exec values derived from them) to buf,
+// which must hold cava_state_size bytes
+
+// cava_load_state, restores a state saved by cava_save_state. The plan must have been
+// initialized with the same parameters, on the same platform, as the saved plan. The
+// output of the plan then continues as the output of the saved plan would have
+extern size_t cava_state_size(struct cava_plan *plan);
+extern void cava_save_state(struct cava_plan *plan, void *buf);
+extern void cava_load_state(struct cava_plan *plan, const void *buf);
+
 // cava_destroy, destroys the plan, frees up memory
 extern void cava_destroy(struct cava_plan *plan);
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "cavacore_fixed.h"
+#ifndef M_PI
+#define M_PI 3.1415926535897932385
+#endif
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAVA_FIXED_TWIDDLE_BITS 30
+
+// magnitude approximation max * alpha + min * beta, Q15, the largest error is 3.96%
+#define CAVA_FIXED_MAG_ALPHA 31471
+#define CAVA_FIXED_MAG_BETA 13036
+
+// the eq multipliers have this many bits, so a band sum times the multiplier fits
+// in 64 bits for FFT sizes up to 16384
+#define CAVA_FIXED_EQ_BITS 21
+
+static int is_power_of_two(int n) { return n > 0 && (n & (n - 1)) == 0; }
+
+struct cava_fixed_plan *cava_fixed_init(struct cava_plan *plan, double exec_rate) {
+    if (plan->autosens || exec_rate <= 0)
+        return NULL;
+    int sizes[3] = {plan->FFTbassbufferSize, plan->FFTmidbufferSize, plan->FFTtreblebufferSize};
+    for (int b = 0; b < 3; b++)
+        if (!is_power_of_two(sizes[b]))
+            return NULL;
+
+    struct cava_fixed_plan *p = malloc(sizeof(struct cava_fixed_plan));
+    int number_of_bars = plan->number_of_bars;
+    int channels = plan->audio_channels;
+    p->number_of_bars = number_of_bars;
+    p->audio_channels = channels;
+    p->bass_cut_off_bar = plan->bass_cut_off_bar;
+    p->treble_cut_off_bar = plan->treble_cut_off_bar;
+    memcpy(p->fft_size, sizes, sizeof(sizes));
+
+    p->ring_size = sizes[0] * channels;
+    p->ring_pos = 0;
+    p->ring = (int16_t *)calloc(p->ring_size, sizeof(int16_t));
+
+    // smoothing, with the falloff of a fixed framerate
+    p->gravity_on = plan->noise_reduction > 0.1;
+    p->noise_reduction = (int32_t)lround(plan->noise_reduction * 32768);
+    double gravity_mod = pow((60 / exec_rate), 2.5) * 1.54 / plan->noise_reduction;
+    if (gravity_mod < 1)
+        gravity_mod = 1;
+    // any larger value drops a bar to 0 after one execution
+    if (gravity_mod > 1000)
+        gravity_mod = 1000;
+    p->gravity_mod = (int64_t)llround(gravity_mod * 65536);
+
+    for (int b = 0; b < 3; b++) {
+        int n = sizes[b];
+        // symmetric, as the samples are windowed newest first
+        p->window[b] = (int16_t *)malloc(n * sizeof(int16_t));
+        for (int i = 0; i < n / 2; i++) {
+            double w = 0.5 * (1 - cos(2 * M_PI * i / (n - 1)));
+            p->window[b][i] = p->window[b][n - 1 - i] = (int16_t)lround(w * 32767);
+        }
+
+        int m = n / 2;
+        int bits = 0;
+        while ((1 << bits) < m)
+            bits++;
+        p->bit_reverse[b] = (int *)malloc(m * sizeof(int));
+        for (int i = 0; i < m; i++) {
+            int rev = 0;
+            for (int j = 0; j < bits; j++)
+                if (i & (1 << j))
+                    rev |= 1 << (bits - 1 - j);
+            p->bit_reverse[b][i] = rev;
+        }
+    }
+
+    p->twiddles = (int32_t *)malloc(sizes[0] * sizeof(int32_t));
+    for (int k = 0; k < sizes[0] / 2; k++) {
+        double phase = -2 * M_PI * k / sizes[0];
+        p->twiddles[2 * k] = (int32_t)lround(cos(phase) * (1 << CAVA_FIXED_TWIDDLE_BITS));
+        p->twiddles[2 * k + 1] = (int32_t)lround(sin(phase) * (1 << CAVA_FIXED_TWIDDLE_BITS));
+    }
+    p->fft = (int32_t *)malloc(sizes[0] * sizeof(int32_t));
+
+    // band bins, and the eq including the average and the output scaling
+    p->FFTbuffer_lower_cut_off = (int *)malloc(number_of_bars * sizeof(int));
+    p->FFTbuffer_upper_cut_off = (int *)malloc(number_of_bars * sizeof(int));
+    p->eq = (uint32_t *)malloc(number_of_bars * sizeof(uint32_t));
+    p->eq_shift = (int *)malloc(number_of_bars * sizeof(int));
+    for (int n = 0; n < number_of_bars; n++) {
+        int band = n <= p->bass_cut_off_bar ? 0 : n <= p->treble_cut_off_bar ? 1 : 2;
+        int max_bin = sizes[band] / 2;
+        int lower = plan->FFTbuffer_lower_cut_off[n];
+        int upper = plan->FFTbuffer_upper_cut_off[n];
+        p->FFTbuffer_lower_cut_off[n] = lower < max_bin ? lower : max_bin;
+        p->FFTbuffer_upper_cut_off[n] = upper < max_bin ? upper : max_bin;
+
+        int exponent;
+        double eq = plan->eq[n] / (upper - lower + 1) * (1 << CAVA_FIXED_BAR_BITS);
+        double mantissa = frexp(eq, &exponent);
+        p->eq[n] = (uint32_t)(mantissa * (1 << CAVA_FIXED_EQ_BITS));
+        p->eq_shift[n] = CAVA_FIXED_EQ_BITS - exponent;
+        if (p->eq_shift[n] < 0 || p->eq_shift[n] > 63) {
+            p->eq[n] = 0;
+            p->eq_shift[n] = 0;
+        }
+    }
+
+    int bars_total = number_of_bars * channels;
+    p->cava_fall = (int32_t *)calloc(bars_total, sizeof(int32_t));
+    p->cava_mem = (int32_t *)calloc(bars_total, sizeof(int32_t));
+    p->cava_peak = (int32_t *)calloc(bars_total, sizeof(int32_t));
+    p->prev_cava_out = (int32_t *)calloc(bars_total, sizeof(int32_t));
+
+    return p;
+}
+
+// complex FFT of the windowed samples of one band and channel, as in cava_execute
+// the samples are taken newest first, and pairs of real values are the real and
+// imaginary parts of the complex values
+static void transform(struct cava_fixed_plan *p, int band, int channel) {
+    int n = p->fft_size[band];
+    int m = n / 2;
+    int channels = p->audio_channels;
+    int mask = p->ring_size - 1;
+    int newest = p->ring_pos - 1 - channel;
+    const int16_t *window = p->window[band];
+    const int *bit_reverse = p->bit_reverse[band];
+    int32_t *fft = p->fft;
+
+    for (int i = 0; i < m; i++) {
+        int pos = newest - 2 * i * channels;
+        int32_t re = (p->ring[pos & mask] * window[2 * i]) >> 15;
+        int32_t im = (p->ring[(pos - channels) & mask] * window[2 * i + 1]) >> 15;
+        fft[2 * bit_reverse[i]] = re;
+        fft[2 * bit_reverse[i] + 1] = im;
+    }
+
+    // the values grow by at most a factor of 2 in each stage, and the windowed
+    // samples have 16 bits, so 32 bits holds FFT sizes up to 16384
+    for (int len = 2; len <= m; len <<= 1) {
+        int half = len / 2;
+        int tw_stride = p->fft_size[0] / len;
+        for (int i = 0; i < m; i += len) {
+            for (int j = 0; j < half; j++) {
+                const int32_t *tw = p->twiddles + 2 * j * tw_stride;
+                int32_t *a = fft + 2 * (i + j);
+                int32_t *b = fft + 2 * (i + j + half);
+                int32_t t_re = (int32_t)(((int64_t)b[0] * tw[0] - (int64_t)b[1] * tw[1]) >>
+                                         CAVA_FIXED_TWIDDLE_BITS);
+                int32_t t_im = (int32_t)(((int64_t)b[0] * tw[1] + (int64_t)b[1] * tw[0]) >>
+                                         CAVA_FIXED_TWIDDLE_BITS);
+                b[0] = a[0] - t_re;
+                b[1] = a[1] - t_im;
+                a[0] += t_re;
+                a[1] += t_im;
+            }
+        }
+    }
+}
+
+static uint64_t magnitude(int64_t re, int64_t im) {
+    uint64_t a = re < 0 ? -re : re;
+    uint64_t b = im < 0 ? -im : im;
+    if (a < b) {
+        uint64_t t = a;
+        a = b;
+        b = t;
+    }
+    return (a * CAVA_FIXED_MAG_ALPHA + b * CAVA_FIXED_MAG_BETA) >> 15;
+}
+
+// magnitude of bin k of the real FFT, split from the complex FFT
+static uint64_t bin_magnitude(const struct cava_fixed_plan *p, int band, int k) {
+    int n = p->fft_size[band];
+    int m = n / 2;
+    const int32_t *z = p->fft;
+    if (k == 0)
+        return magnitude((int64_t)z[0] + z[1], 0);
+    if (k == m)
+        return magnitude((int64_t)z[0] - z[1], 0);
+
+    // twice the value, from the transforms of the even and odd samples
+    const int32_t *a = z + 2 * k;
+    const int32_t *b = z + 2 * (m - k);
+    int64_t even_re = (int64_t)a[0] + b[0];
+    int64_t even_im = (int64_t)a[1] - b[1];
+    int64_t odd_re = (int64_t)a[1] + b[1];
+    int64_t odd_im = (int64_t)b[0] - a[0];
+    const int32_t *w = p->twiddles + 2 * k * (p->fft_size[0] / n);
+    int64_t re = even_re + ((odd_re * w[0] - odd_im * w[1]) >> CAVA_FIXED_TWIDDLE_BITS);
+    int64_t im = even_im + ((odd_re * w[1] + odd_im * w[0]) >> CAVA_FIXED_TWIDDLE_BITS);
+    return magnitude(re, im) / 2;
+}
+
+void cava_fixed_execute(const int16_t *cava_in, int new_samples, int32_t *cava_out,
+                        struct cava_fixed_plan *p) {
+
+    // do not overflow
+    if (new_samples > p->ring_size)
+        new_samples = p->ring_size;
+
+    int mask = p->ring_size - 1;
+    for (int n = 0; n < new_samples; n++)
+        p->ring[(p->ring_pos + n) & mask] = cava_in[n];
+    p->ring_pos = (p->ring_pos + new_samples) & mask;
+
+    // process: execute FFT and sort frequency bands
+    int first_bar[3] = {0, p->bass_cut_off_bar + 1, p->treble_cut_off_bar + 1};
+    int end_bar[3] = {p->bass_cut_off_bar + 1, p->treble_cut_off_bar + 1, p->number_of_bars};
+    for (int band = 0; band < 3; band++) {
+        if (first_bar[band] >= end_bar[band])
+            continue;
+        for (int c = 0; c < p->audio_channels; c++) {
+            transform(p, band, c);
+            for (int n = first_bar[band]; n < end_bar[band]; n++) {
+                uint64_t sum = 0;
+                for (int k = p->FFTbuffer_lower_cut_off[n]; k <= p->FFTbuffer_upper_cut_off[n];
+                     k++)
+                    sum += bin_magnitude(p, band, k);
+                uint64_t val = (sum * p->eq[n]) >> p->eq_shift[n];
+                cava_out[n + c * p->number_of_bars] = val > INT32_MAX ? INT32_MAX : (int32_t)val;
+            }
+        }
+    }
+
+    // process [smoothing]
+    for (int n = 0; n < p->number_of_bars * p->audio_channels; n++) {
+
+        // process [smoothing]: falloff
+        if (cava_out[n] < p->prev_cava_out[n] && p->gravity_on) {
+            int64_t fall = p->cava_fall[n];
+            int64_t drop = fall * fall * p->gravity_mod / 1000;
+            if (drop < 65536) {
+                cava_out[n] = (int32_t)((p->cava_peak[n] * (65536 - drop)) >> 16);
+                p->cava_fall[n]++;
+            } else {
+                // the bar has fallen to 0, and stops the fall count before it can overflow
+                cava_out[n] = 0;
+            }
+        } else {
+            p->cava_peak[n] = cava_out[n];
+            p->cava_fall[n] = 0;
+        }
+        p->prev_cava_out[n] = cava_out[n];
+
+        // process [smoothing]: integral
+        int64_t out = (((int64_t)p->cava_mem[n] * p->noise_reduction) >> 15) + cava_out[n];
+        cava_out[n] = out > INT32_MAX ? INT32_MAX : (int32_t)out;
+        p->cava_mem[n] = cava_out[n];
+    }
+}
+
+void cava_fixed_destroy(struct cava_fixed_plan *p) {
+    free(p->ring);
+    for (int b = 0; b < 3; b++) {
+        free(p->window[b]);
+        free(p->bit_reverse[b]);
+    }
+    free(p->twiddles);
+    free(p->fft);
+    free(p->FFTbuffer_lower_cut_off);
+    free(p->FFTbuffer_upper_cut_off);
+    free(p->eq);
+    free(p->eq_shift);
+    free(p->cava_fall);
+    free(p->cava_mem);
+    free(p->cava_peak);
+    free(p->prev_cava_out);
+}
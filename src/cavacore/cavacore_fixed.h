@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+
+#include "cavacore.h"
+
+// cava_fixed_plan, a version of a cava_plan that processes pcm_s16 samples with
+// integer arithmetic only, for processors with slow floating point. The input is
+// kept in an int16 ring buffer and windowed with a Q15 Hann window, the FFT is an
+// integer radix 2 FFT with Q30 twiddles, the magnitudes are approximated as
+// 0.960 * max + 0.398 * min of the absolute real and imaginary parts (within 4%),
+// and the smoothing is in fixed point. Autosens is not supported, and the FFT
+// sizes must be powers of two, for sample rates up to 300000
+//
+// parameters used internally by cavacore_fixed, do not modify these directly
+struct cava_fixed_plan {
+    int number_of_bars;
+    int audio_channels;
+    int bass_cut_off_bar;
+    int treble_cut_off_bar;
+    int fft_size[3];   // bass, mid and treble real FFT sizes
+    int ring_size;     // samples in the ring buffer, the bass FFT size * channels
+    int ring_pos;      // index in the ring buffer of the next sample
+    int gravity_on;    // the falloff is applied
+    int32_t noise_reduction; // Q15
+    int64_t gravity_mod;     // Q16
+
+    int16_t *ring;
+    int16_t *window[3];     // Q15 Hann window for each band
+    int *bit_reverse[3];    // order of the complex FFT values of each band
+    int32_t *twiddles;      // exp(-2 pi i k / bass FFT size), k < size / 2, Q30 pairs
+    int32_t *fft;           // complex FFT values, real and imaginary pairs
+
+    int *FFTbuffer_lower_cut_off;
+    int *FFTbuffer_upper_cut_off;
+    uint32_t *eq;  // bar eq and average, eq[n] / 2^eq_shift[n], with output scaling
+    int *eq_shift;
+
+    int32_t *cava_fall;
+    int32_t *cava_mem;
+    int32_t *cava_peak;
+    int32_t *prev_cava_out;
+};
+
+// the bar values output by cava_fixed_execute have this many fractional bits
+#define CAVA_FIXED_BAR_BITS 12
+
+// cava_fixed_init, initialize fixed point visualization, takes the following parameters:
+
+// plan, a cava_plan from cava_init, the fixed point plan has the same bars, band
+// layout, eq and noise reduction. The plan is only read during cava_fixed_init,
+// and may then be destroyed
+
+// exec_rate, the number of executions per second, which sets the falloff as for
+// cava_set_exec_rate, the fixed point plan does not estimate it
+
+// returns a cava_fixed_plan to be used by cava_fixed_execute, or NULL if the plan
+// uses autosens or its FFT sizes are not powers of two
+extern struct cava_fixed_plan *cava_fixed_init(struct cava_plan *plan, double exec_rate);
+
+// cava_fixed_execute, executes fixed point visualization, as cava_execute
+
+// cava_in, pcm_s16 input samples, interleaved if there are two channels
+
+// new_samples, the number of samples in cava_in to be processed
+
+// cava_out, output buffer for number of bars * number of channels values, in the
+// order of cava_execute, in fixed point with CAVA_FIXED_BAR_BITS fractional bits
+extern void cava_fixed_execute(const int16_t *cava_in, int new_samples, int32_t *cava_out,
+                               struct cava_fixed_plan *plan);
+
+// cava_fixed_destroy, destroys the plan, frees up memory
+extern void cava_fixed_destroy(struct cava_fixed_plan *plan);
@@ -0,0 +1,111 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file checkpoint.cpp
+   \brief state saved to resume an interrupted run
+*/
+
+#include "checkpoint.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+using std::string;
+
+namespace {
+const char magic[] = "CAVACKP1";
+const size_t magic_len = sizeof(magic) - 1;
+
+bool write_uint64(FILE *file, uint64_t val)
+{
+  return fwrite(&val, sizeof(val), 1, file) == 1;
+}
+
+bool read_uint64(FILE *file, uint64_t *val)
+{
+  return fread(val, sizeof(*val), 1, file) == 1;
+}
+} // namespace
+
+Status Checkpoint::write(const string &path) const
+{
+  string tmp_path = path + ".tmp";
+  FILE *file = fopen(tmp_path.c_str(), "wb");
+  if (!file)
+    return Status::error("could not open checkpoint file for writing '" +
+                         tmp_path + "': " + strerror(errno));
+
+  bool ok = fwrite(magic, 1, magic_len, file) == magic_len &&
+            write_uint64(file, options.size()) &&
+            fwrite(options.data(), 1, options.size(), file) ==
+                options.size() &&
+            write_uint64(file, input_offset) &&
+            write_uint64(file, output_offset) &&
+            write_uint64(file, state.size()) &&
+            fwrite(state.data(), 1, state.size(), file) == state.size();
+  if (fclose(file) != 0)
+    ok = false;
+
+  if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    Status stat = Status::error("could not write checkpoint file '" + path +
+                                "': " + strerror(errno));
+    remove(tmp_path.c_str());
+    return stat;
+  }
+
+  return Status::ok();
+}
+
+Status Checkpoint::read(const string &path)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file)
+    return Status::error("could not open checkpoint file for reading '" +
+                         path + "': " + strerror(errno));
+
+  char file_magic[magic_len];
+  uint64_t options_len = 0;
+  uint64_t state_len = 0;
+  bool ok = fread(file_magic, 1, magic_len, file) == magic_len &&
+            memcmp(file_magic, magic, magic_len) == 0 &&
+            read_uint64(file, &options_len) && options_len < 4096;
+  if (ok) {
+    options.resize(options_len);
+    ok = fread(&options[0], 1, options_len, file) == options_len &&
+         read_uint64(file, &input_offset) &&
+         read_uint64(file, &output_offset) && read_uint64(file, &state_len) &&
+         state_len < (1 << 30);
+  }
+  if (ok) {
+    state.resize(state_len);
+    ok = fread(state.data(), 1, state_len, file) == state_len;
+  }
+  fclose(file);
+
+  if (!ok)
+    return Status::error("invalid checkpoint file '" + path + "'");
+
+  return Status::ok();
+}
@@ -0,0 +1,60 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file checkpoint.hpp
+   \brief state saved to resume an interrupted run
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "status_msg.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// State saved to resume an interrupted run
+struct Checkpoint {
+  std::string options;        ///< the options that affect the output
+  uint64_t input_offset = 0;  ///< input bytes processed into complete frames
+  uint64_t output_offset = 0; ///< output bytes written for those frames
+  std::vector<char> state;    ///< the generator state at the checkpoint
+
+  /// Write the checkpoint to a file
+  /** The file is replaced atomically, so an interrupted write leaves the
+   *  previous checkpoint.
+   * \param path the file path.
+   * \return status, evaluates to \c true if the checkpoint was written,
+   *  otherwise \c false.*/
+  Status write(const std::string &path) const;
+
+  /// Read the checkpoint from a file
+  /**\param path the file path.
+   * \return status, evaluates to \c true if the checkpoint was read,
+   *  otherwise \c false.*/
+  Status read(const std::string &path);
+};
+
+#endif // CHECKPOINT_H
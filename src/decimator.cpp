@@ -0,0 +1,122 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file decimator.cpp
+   \brief reduce the sample rate by an integer factor with an anti-alias filter
+*/
+
+#include "decimator.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace {
+const double stop_band_atten = 80; // dB
+
+// modified Bessel function of the first kind, order 0
+double bessel_i0(double x)
+{
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 50 && term > 1e-12 * sum; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+// the filter transition must be at least this wide, which limits the filter
+// length to about rate / 200
+const int min_transition = 1000; // Hz
+
+bool is_valid_factor(int rate, int pass_freq, int factor)
+{
+  int out_rate = rate / factor;
+  // frequencies above out_rate - pass_freq alias to above pass_freq
+  return rate % factor == 0 && out_rate - 2 * pass_freq >= min_transition;
+}
+}; // namespace
+
+int Decimator::choose_factor(int rate, int pass_freq, int max_factor)
+{
+  for (int f = max_factor; f > 1; f--)
+    if (is_valid_factor(rate, pass_freq, f))
+      return f;
+  return 1;
+}
+
+Status Decimator::init(int rate, int decimation_factor, int pass_freq,
+                       int num_channels)
+{
+  if (decimation_factor < 1)
+    return Status::error("decimation factor must be greater than 0");
+  if (decimation_factor > 1 &&
+      !is_valid_factor(rate, pass_freq, decimation_factor))
+    return Status::error("cannot decimate rate " + std::to_string(rate) +
+                         " by " + std::to_string(decimation_factor) +
+                         " and keep the high cutoff frequency");
+
+  factor = decimation_factor;
+  channels = num_channels;
+  if (factor == 1) {
+    // a single tap passes the samples through
+    taps.assign(1, 1.0);
+  }
+  else {
+    // Kaiser window design, frequencies in cycles per input sample
+    double pass = (double)pass_freq / rate;
+    double stop = (double)(rate / factor - pass_freq) / rate;
+    double cut_off = (pass + stop) / 2;
+    int len = ceil((stop_band_atten - 8) / (2.285 * 2 * M_PI * (stop - pass)));
+    len += !(len % 2); // odd, for a whole sample delay
+    double beta = 0.1102 * (stop_band_atten - 8.7);
+    double centre = (len - 1) / 2.0;
+    taps.resize(len);
+    double sum = 0.0;
+    for (int i = 0; i < len; i++) {
+      double t = i - centre;
+      double sinc = (t == 0) ? 2 * cut_off
+                             : sin(2 * M_PI * cut_off * t) / (M_PI * t);
+      double r = t / centre;
+      taps[i] = sinc * bessel_i0(beta * sqrt(std::max(0.0, 1 - r * r))) /
+                bessel_i0(beta);
+      sum += taps[i];
+    }
+    // unit gain at 0 Hz
+    for (auto &tap : taps)
+      tap /= sum;
+  }
+
+  reset();
+  return Status::ok();
+}
+
+void Decimator::reset()
+{
+  history.assign(2 * taps.size() * channels, 0.0);
+  pos = 0;
+  channel = 0;
+  countdown = factor;
+}
@@ -0,0 +1,118 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file decimator.hpp
+   \brief reduce the sample rate by an integer factor with an anti-alias filter
+*/
+
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <vector>
+
+/// Reduce the sample rate of interleaved samples by an integer factor
+/** The samples are filtered by a Kaiser windowed low pass FIR filter, and
+ *  only every factor'th output of the filter is calculated (a polyphase
+ *  decimator). The filter passes the frequencies up to a pass frequency,
+ *  and attenuates by at least 80 dB the frequencies that would alias to
+ *  below it at the output rate. */
+class Decimator {
+private:
+  int factor = 1;
+  int channels = 1;
+  std::vector<double> taps;     // filter coefficients, oldest sample first
+  std::vector<double> history;  // recent samples of each channel, twice over
+  int pos = 0;        // index in history of the next sample of a channel
+  int channel = 0;    // channel of the next sample
+  int countdown = 0;  // input sample frames until the next output frame
+
+public:
+  /// Find the largest factor that keeps a frequency below the output
+  /// Nyquist frequency, with room for the filter transition
+  /**\param rate the input sample rate.
+   * \param pass_freq the highest frequency to keep.
+   * \param max_factor the largest factor to consider.
+   * \return The factor, which divides \a rate, or \c 1 if the rate cannot
+   *  be reduced. */
+  static int choose_factor(int rate, int pass_freq, int max_factor = 16);
+
+  /// Initialise
+  /**\param rate the input sample rate.
+   * \param decimation_factor the input rate divided by the output rate.
+   * \param pass_freq the highest frequency to keep, which must be below
+   *  half of the output rate.
+   * \param num_channels the number of interleaved channels.
+   * \return status, evaluates to \c true if the decimator was initialised,
+   *  otherwise \c false.*/
+  Status init(int rate, int decimation_factor, int pass_freq,
+              int num_channels);
+
+  /// Get the decimation factor
+  /**\return The input rate divided by the output rate. */
+  int get_factor() const { return factor; }
+
+  /// Get the number of filter coefficients
+  /**\return The filter length. */
+  size_t get_filter_length() const { return taps.size(); }
+
+  /// Clear the filter history
+  void reset();
+
+  /// Add an input sample
+  /** Samples are added in interleaved order. An output sample frame is
+   *  written when every factor'th input frame is complete.
+   * \param sample the sample value.
+   * \param out buffer for an output frame, of one value for each channel.
+   * \return The number of values written to \a out, \c 0 or the number of
+   *  channels. */
+  int add(double sample, double *out)
+  {
+    const int len = taps.size();
+    double *hist = history.data() + channel * 2 * len;
+    hist[pos] = hist[pos + len] = sample;
+    if (++channel < channels)
+      return 0;
+
+    channel = 0;
+    pos = (pos + 1) % len;
+    if (--countdown > 0)
+      return 0;
+
+    countdown = factor;
+    for (int c = 0; c < channels; c++) {
+      // the oldest sample is at pos
+      const double *samples = history.data() + c * 2 * len + pos;
+      double sum = 0.0;
+      for (int i = 0; i < len; i++)
+        sum += taps[i] * samples[i];
+      out[c] = sum;
+    }
+    return channels;
+  }
+};
+
+#endif // DECIMATOR_H
@@ -0,0 +1,131 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file frame_index.cpp
+   \brief index of the output offsets of frames, for random access
+*/
+
+#include "frame_index.hpp"
+#include "utils.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+namespace {
+const char frame_index_magic[8] = {'C', 'A', 'V', 'A', 'I', 'D', 'X', '1'};
+}; // namespace
+
+FrameIndexWriter::~FrameIndexWriter()
+{
+  if (file)
+    fclose(file);
+}
+
+Status FrameIndexWriter::open(const std::string &file_path,
+                              int frame_interval, double framerate,
+                              uint64_t first_frame)
+{
+  if (frame_interval < 1)
+    return Status::error("index interval must be greater than 0");
+
+  path = file_path;
+  file = fopen(path.c_str(), "wb");
+  if (!file)
+    return Status::error("could not open file for writing '" + path +
+                         "': " + strerror(errno));
+
+  FrameIndexHeader header;
+  memcpy(header.magic, frame_index_magic, sizeof(header.magic));
+  header.interval = frame_interval;
+  header.reserved = 0;
+  header.framerate = framerate;
+  header.first_frame = first_frame;
+  interval = frame_interval;
+  frame_count = 0;
+  write_failed = fwrite(&header, sizeof(header), 1, file) != 1;
+
+  return Status::ok();
+}
+
+void FrameIndexWriter::add_frame(uint64_t offset)
+{
+  if (file && frame_count++ % interval == 0)
+    write_failed |= fwrite(&offset, sizeof(offset), 1, file) != 1;
+}
+
+Status FrameIndexWriter::close()
+{
+  if (!file)
+    return Status::ok();
+
+  write_failed |= fclose(file) != 0;
+  file = nullptr;
+  if (write_failed)
+    return Status::error("writing '" + path + "': " + strerror(errno));
+
+  return Status::ok();
+}
+
+FrameIndexReader::~FrameIndexReader()
+{
+  if (file)
+    fclose(file);
+}
+
+Status FrameIndexReader::open(const std::string &file_path)
+{
+  if (file)
+    fclose(file);
+  file = fopen(file_path.c_str(), "rb");
+  if (!file)
+    return Status::error("could not open file for reading '" + file_path +
+                         "': " + strerror(errno));
+
+  long size = -1;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, frame_index_magic, sizeof(header.magic)) != 0 ||
+      header.interval < 1 || fseek(file, 0, SEEK_END) != 0 ||
+      (size = ftell(file)) < (long)sizeof(header))
+    return Status::error("not a valid index file '" + file_path + "'");
+
+  num_entries = (size - sizeof(header)) / sizeof(uint64_t);
+  return Status::ok();
+}
+
+Status FrameIndexReader::find(uint64_t frame, uint64_t *entry_frame,
+                              uint64_t *offset)
+{
+  uint64_t entry = frame / header.interval;
+  if (entry >= num_entries)
+    return Status::error(
+        msg_str("frame %llu is after the end of the index",
+                (unsigned long long)frame));
+
+  if (fseek(file, sizeof(header) + entry * sizeof(uint64_t), SEEK_SET) != 0 ||
+      fread(offset, sizeof(uint64_t), 1, file) != 1)
+    return Status::error(std::string("reading index: ") + strerror(errno));
+
+  *entry_frame = entry * header.interval;
+  return Status::ok();
+}
@@ -0,0 +1,140 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file frame_index.hpp
+   \brief index of the output offsets of frames, for random access
+*/
+
+#ifndef FRAME_INDEX_H
+#define FRAME_INDEX_H
+
+#include "status_msg.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/// Header of a frame index file
+/** The header is followed, in native byte order, by the output offset of
+ *  every \c interval frames, starting with frame 0, as \c uint64_t. The
+ *  frames are numbered from the first frame in the output, which is
+ *  frame \c first_frame of the input. */
+struct FrameIndexHeader {
+  char magic[8];        ///< "CAVAIDX1"
+  uint32_t interval;    ///< number of frames between entries
+  uint32_t reserved;    ///< zero
+  double framerate;     ///< frames per second
+  uint64_t first_frame; ///< input frame number of the first output frame
+};
+
+/// Write a frame index file
+class FrameIndexWriter {
+private:
+  FILE *file = nullptr;
+  std::string path;
+  uint32_t interval = 1;
+  uint64_t frame_count = 0;
+  bool write_failed = false;
+
+public:
+  /// Constructor
+  FrameIndexWriter() = default;
+  FrameIndexWriter(const FrameIndexWriter &) = delete;
+  FrameIndexWriter &operator=(const FrameIndexWriter &) = delete;
+
+  /// Destructor
+  ~FrameIndexWriter();
+
+  /// Start a frame index
+  /**\param file_path the index file path.
+   * \param frame_interval the number of frames between entries.
+   * \param framerate the frames per second.
+   * \param first_frame the input frame number of the first output frame.
+   * \return status, evaluates to \c true if the index was started,
+   *  otherwise \c false.*/
+  Status open(const std::string &file_path, int frame_interval,
+              double framerate, uint64_t first_frame);
+
+  /// Add the next frame
+  /** Errors are reported by close().
+   * \param offset the output offset of the start of the frame. */
+  void add_frame(uint64_t offset);
+
+  /// Finish the frame index
+  /**\return status, evaluates to \c true if the index was written,
+   *  otherwise \c false.*/
+  Status close();
+};
+
+/// Read a frame index file
+/** An entry is read directly from its position in the file. */
+class FrameIndexReader {
+private:
+  FILE *file = nullptr;
+  FrameIndexHeader header;
+  uint64_t num_entries = 0;
+
+public:
+  /// Constructor
+  FrameIndexReader() = default;
+  FrameIndexReader(const FrameIndexReader &) = delete;
+  FrameIndexReader &operator=(const FrameIndexReader &) = delete;
+
+  /// Destructor
+  ~FrameIndexReader();
+
+  /// Open a frame index file
+  /**\param file_path the index file path.
+   * \return status, evaluates to \c true if the index was opened,
+   *  otherwise \c false.*/
+  Status open(const std::string &file_path);
+
+  /// Get the number of frames between entries
+  /**\return The interval. */
+  uint32_t get_interval() const { return header.interval; }
+
+  /// Get the framerate
+  /**\return The frames per second. */
+  double get_framerate() const { return header.framerate; }
+
+  /// Get the input frame number of the first output frame
+  /**\return The frame number. */
+  uint64_t get_first_frame() const { return header.first_frame; }
+
+  /// Get the number of frames covered by the index
+  /**\return The number of frames, rounded up to a multiple of the
+   *  interval. */
+  uint64_t get_num_frames() const { return num_entries * header.interval; }
+
+  /// Find the output offset of the entry for a frame
+  /**\param frame the output frame number.
+   * \param entry_frame used to return the frame number of the entry, the
+   *  last entry at or before \a frame.
+   * \param offset used to return the output offset of the entry frame.
+   * \return status, evaluates to \c true if the entry was found,
+   *  otherwise \c false.*/
+  Status find(uint64_t frame, uint64_t *entry_frame, uint64_t *offset);
+};
+
+#endif // FRAME_INDEX_H
@@ -0,0 +1,89 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file frame_reader.cpp
+   \brief read frames of spectrum bar values on demand from an audio input
+*/
+
+#include "frame_reader.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+Status FrameReader::init(const CavaPlanParams &params, double framerate,
+                         SampleSource sample_source,
+                         const SampleConversion &conversion, size_t block_len)
+{
+  if (block_len < 2)
+    return Status::error("read block length must be at least 2 samples");
+
+  Status stat_init = generator.init(params, framerate, nullptr, conversion);
+  if (!stat_init)
+    return stat_init;
+
+  source = sample_source;
+  samples.assign(block_len, 0);
+  samples_pos = 0;
+  samples_len = 0;
+  frame.assign(generator.get_bars_total(), 0.0);
+  has_frame = false;
+  at_end = false;
+  stat = Status::ok();
+
+  return Status::ok();
+}
+
+FrameReader::SampleSource FrameReader::file_source(FILE *file)
+{
+  return [file](int16_t *buf, size_t max, size_t *num) {
+    *num = fread(buf, sizeof(int16_t), max, file);
+    if (ferror(file))
+      return Status::error(std::string("reading input: ") + strerror(errno));
+    return Status::ok();
+  };
+}
+
+bool FrameReader::next()
+{
+  has_frame = false;
+  while (!has_frame && stat && !at_end) {
+    if (samples_pos == samples_len) {
+      samples_pos = 0;
+      samples_len = 0;
+      stat = source(samples.data(), samples.size(), &samples_len);
+      at_end = !stat || samples_len == 0;
+      continue;
+    }
+
+    // stops at the end of the frame, the rest of the samples are kept
+    size_t num_frames;
+    samples_pos += generator.push(samples.data() + samples_pos,
+                                  samples_len - samples_pos, frame.data(), 1,
+                                  &num_frames);
+    has_frame = num_frames > 0;
+  }
+
+  return has_frame;
+}
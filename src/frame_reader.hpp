@@ -0,0 +1,184 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file frame_reader.hpp
+   \brief read frames of spectrum bar values on demand from an audio input
+*/
+
+#ifndef FRAME_READER_H
+#define FRAME_READER_H
+
+#include "spectrum_generator.hpp"
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+/// Read frames of spectrum bar values on demand from an audio input
+/** Frames are pulled one at a time, and only the samples for the frames
+ *  pulled are read and processed, so a consumer that needs a frame only
+ *  when it is about to use it, and may stop early, does not process the
+ *  whole input. The reader is also a range of frames, for use in a range
+ *  based for loop, and a loop that is left early costs nothing further.
+ *  The frames are the same as those passed to the frame handler of a
+ *  SpectrumGenerator. */
+class FrameReader {
+public:
+  /// Source of samples
+  /** Reads interleaved pcm_s16le samples.
+   * \param samples the buffer for the samples.
+   * \param max the number of samples the buffer can hold.
+   * \param num used to return the number of samples read, \c 0 at the end
+   *  of the input.
+   * \return status, evaluates to \c true if the samples were read,
+   *  otherwise \c false.*/
+  typedef std::function<Status(int16_t *samples, size_t max, size_t *num)>
+      SampleSource;
+
+  /// Iterator over the frames of a reader
+  /** An input iterator, dereferencing gives the bar values of the current
+   *  frame, and incrementing reads the next frame. An iterator at the end
+   *  of the input, or after an error, compares equal to end(). */
+  class iterator {
+  private:
+    FrameReader *reader = nullptr; // nullptr at the end
+
+  public:
+    typedef std::input_iterator_tag iterator_category;
+    typedef const double *value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const double *const *pointer;
+    typedef const double *reference;
+
+    /// Constructor, the end iterator
+    iterator() = default;
+
+    /// Constructor
+    /**\param frame_reader the reader, which must have a current frame. */
+    explicit iterator(FrameReader *frame_reader) : reader(frame_reader) {}
+
+    /// Get the bar values of the current frame
+    /**\return The bar values, as for get_frame(). */
+    const double *operator*() const { return reader->get_frame(); }
+
+    /// Read the next frame
+    /**\return A reference to this iterator. */
+    iterator &operator++()
+    {
+      if (!reader->next())
+        reader = nullptr;
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const
+    {
+      return reader == other.reader;
+    }
+    bool operator!=(const iterator &other) const { return !(*this == other); }
+  };
+
+private:
+  SpectrumGenerator generator;
+  SampleSource source;
+  std::vector<int16_t> samples; // samples read and not yet processed
+  size_t samples_pos = 0;       // next sample to process
+  size_t samples_len = 0;       // number of samples read
+  std::vector<double> frame;    // bar values of the current frame
+  bool has_frame = false;       // whether there is a current frame
+  bool at_end = false;          // the source has no more samples
+  Status stat;
+
+public:
+  /// Initialise
+  /** No samples are read until the first frame is pulled.
+   * \param params the cava plan parameters.
+   * \param framerate the number of frames per second.
+   * \param sample_source the source of the samples.
+   * \param conversion the conversion of the samples for the plan.
+   * \param block_len the number of samples read from the source at a
+   *  time, the input is read at most this far beyond the current frame.
+   * \return status, evaluates to \c true if the reader was initialised,
+   *  otherwise \c false.*/
+  Status init(const CavaPlanParams &params, double framerate,
+              SampleSource sample_source,
+              const SampleConversion &conversion = SampleConversion(),
+              size_t block_len = 8192);
+
+  /// Make a source that reads samples from a file
+  /**\param file the file, which must remain open while reading.
+   * \return The source. */
+  static SampleSource file_source(FILE *file);
+
+  /// Get the generator
+  /** For setting options of the generator, e.g. set_exact_framerate(),
+   *  after init() and before the first frame is pulled. The frame handler
+   *  is not called.
+   * \return The generator. */
+  SpectrumGenerator &get_generator() { return generator; }
+
+  /// Read the next frame
+  /** Reads and processes samples until the next frame is complete.
+   * \return \c true if there is a next frame, otherwise \c false, at the
+   *  end of the input or after an error (see get_status()). */
+  bool next();
+
+  /// Get the bar values of the current frame
+  /**\return The bar values, as for SpectrumGenerator::FrameHandler, valid
+   *  until the next frame is read, or \c nullptr if there is no current
+   *  frame. */
+  const double *get_frame() const
+  {
+    return has_frame ? frame.data() : nullptr;
+  }
+
+  /// Get the number of the current frame
+  /**\return The frame number, counting from \c 0 for the first frame. */
+  uint64_t get_frame_number() const
+  {
+    return generator.get_frame_count() - 1;
+  }
+
+  /// Get the status of reading
+  /**\return status, evaluates to \c false if reading the source failed. */
+  const Status &get_status() const { return stat; }
+
+  /// Get an iterator at the current frame
+  /** Reads the first frame if no frame has been read, so a loop that
+   *  starts again continues from the last frame of the earlier loop.
+   * \return The iterator, or end() if there are no more frames. */
+  iterator begin()
+  {
+    return (has_frame || next()) ? iterator(this) : iterator();
+  }
+
+  /// Get the end iterator
+  /**\return The iterator. */
+  iterator end() { return iterator(); }
+};
+
+#endif // FRAME_READER_H
@@ -0,0 +1,240 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file loudness.cpp
+   \brief sample levels and EBU R128 loudness of frames of a sample stream
+*/
+
+#include "loudness.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+// blocks of 100 ms in the momentary and short-term windows
+const size_t momentary_blocks = 4;
+const size_t short_term_blocks = 30;
+
+// integrated loudness gates, in LUFS and LU
+const double absolute_gate = -70.0;
+const double relative_gate = -10.0;
+
+// histogram bins of 0.1 LU from the absolute gate
+const double hist_bins_per_lu = 10.0;
+const size_t hist_size = 800; // to +10 LUFS, above any block of samples
+
+// filter states below this are set to zero. During silence the states
+// decay towards zero and would otherwise pass through the denormal range,
+// where arithmetic is very slow on x86
+const double filter_state_floor = 1e-200;
+
+const double full_scale = 32768.0;
+
+double power_to_loudness(double power)
+{
+  // the channel weights are 1 for mono and for left and right
+  if (power <= 0.0)
+    return -std::numeric_limits<double>::infinity();
+  return -0.691 + 10 * log10(power);
+}
+
+double power_to_db(double power)
+{
+  if (power <= 0.0)
+    return -std::numeric_limits<double>::infinity();
+  return 10 * log10(power);
+}
+}; // namespace
+
+Status LoudnessMeter::init(int rate, int num_channels)
+{
+  if (rate < 1)
+    return Status::error("sample rate must be positive");
+  if (num_channels < 1 || num_channels > 2)
+    return Status::error("invalid number of channels, should be 1 or 2");
+
+  channels = num_channels;
+  block_len = std::max(1, (int)lround(rate / 10.0));
+
+  // K-weighting, as specified for 48000 Hz in BS.1770 and derived for
+  // other rates with the filter parameters of that response
+
+  // high shelf, a boost of about 4 dB above about 1.5 kHz
+  const double shelf_freq = 1681.974450955533;
+  const double shelf_gain = 3.999843853973347; // dB
+  const double shelf_q = 0.7071752369554196;
+  double k = tan(M_PI * shelf_freq / rate);
+  const double vh = pow(10.0, shelf_gain / 20);
+  const double vb = pow(vh, 0.4996667741545416);
+  double a0 = 1 + k / shelf_q + k * k;
+  shelf_b[0] = (vh + vb * k / shelf_q + k * k) / a0;
+  shelf_b[1] = 2 * (k * k - vh) / a0;
+  shelf_b[2] = (vh - vb * k / shelf_q + k * k) / a0;
+  shelf_a[0] = 1.0;
+  shelf_a[1] = 2 * (k * k - 1) / a0;
+  shelf_a[2] = (1 - k / shelf_q + k * k) / a0;
+
+  // high pass, at about 38 Hz
+  const double pass_freq = 38.13547087602444;
+  const double pass_q = 0.5003270373238773;
+  k = tan(M_PI * pass_freq / rate);
+  a0 = 1 + k / pass_q + k * k;
+  pass_b[0] = 1.0;
+  pass_b[1] = -2.0;
+  pass_b[2] = 1.0;
+  pass_a[0] = 1.0;
+  pass_a[1] = 2 * (k * k - 1) / a0;
+  pass_a[2] = (1 - k / pass_q + k * k) / a0;
+
+  filter_state.assign(4 * channels, 0.0);
+  blocks.assign(short_term_blocks, 0.0);
+  hist_counts.assign(hist_size, 0);
+  hist_powers.assign(hist_size, 0.0);
+  reset();
+
+  return Status::ok();
+}
+
+void LoudnessMeter::reset()
+{
+  channel = 0;
+  block_fill = 0;
+  std::fill(filter_state.begin(), filter_state.end(), 0.0);
+  block_sum = 0.0;
+  std::fill(blocks.begin(), blocks.end(), 0.0);
+  block_idx = 0;
+  num_blocks = 0;
+  std::fill(hist_counts.begin(), hist_counts.end(), 0);
+  std::fill(hist_powers.begin(), hist_powers.end(), 0.0);
+  frame_sum = 0.0;
+  frame_peak = 0.0;
+  frame_samples = 0;
+  frame_levels = FrameLevels();
+}
+
+void LoudnessMeter::add(const int16_t *samples, size_t num)
+{
+  for (size_t i = 0; i < num; i++) {
+    const double x = samples[i];
+    frame_sum += x * x;
+    frame_peak = std::max(frame_peak, std::fabs(x));
+
+    // K-weighting, transposed direct form II biquads
+    double *state = filter_state.data() + 4 * channel;
+    const double in = x / full_scale;
+    const double shelf = shelf_b[0] * in + state[0];
+    state[0] = shelf_b[1] * in - shelf_a[1] * shelf + state[1];
+    state[1] = shelf_b[2] * in - shelf_a[2] * shelf;
+    const double out = pass_b[0] * shelf + state[2];
+    state[2] = pass_b[1] * shelf - pass_a[1] * out + state[3];
+    state[3] = pass_b[2] * shelf - pass_a[2] * out;
+    block_sum += out * out;
+
+    if (++channel == channels) {
+      channel = 0;
+      if (++block_fill == block_len)
+        end_block();
+    }
+  }
+  frame_samples += num;
+}
+
+void LoudnessMeter::end_block()
+{
+  blocks[block_idx] = block_sum / block_len;
+  block_idx = (block_idx + 1) % blocks.size();
+  num_blocks++;
+  block_sum = 0.0;
+  block_fill = 0;
+  for (auto &state : filter_state)
+    if (std::fabs(state) < filter_state_floor)
+      state = 0.0;
+
+  // a gating block of 400 ms ends every 100 ms
+  if (num_blocks < momentary_blocks)
+    return;
+  const double power = get_blocks_power(momentary_blocks);
+  const double loudness = power_to_loudness(power);
+  if (loudness <= absolute_gate)
+    return;
+  size_t bin = (loudness - absolute_gate) * hist_bins_per_lu;
+  bin = std::min(bin, hist_size - 1);
+  hist_counts[bin]++;
+  hist_powers[bin] += power;
+}
+
+// mean square of the last num blocks
+double LoudnessMeter::get_blocks_power(size_t num) const
+{
+  double sum = 0.0;
+  for (size_t i = 1; i <= num; i++)
+    sum += blocks[(block_idx + blocks.size() - i) % blocks.size()];
+  return sum / num;
+}
+
+void LoudnessMeter::end_frame()
+{
+  frame_levels.rms = power_to_db(
+      frame_samples ? frame_sum / frame_samples / (full_scale * full_scale)
+                    : 0.0);
+  // the square of the amplitude ratio
+  frame_levels.peak = 2 * power_to_db(frame_peak / full_scale);
+  frame_levels.momentary =
+      power_to_loudness(get_blocks_power(momentary_blocks));
+  frame_levels.short_term =
+      power_to_loudness(get_blocks_power(short_term_blocks));
+
+  frame_sum = 0.0;
+  frame_peak = 0.0;
+  frame_samples = 0;
+}
+
+double LoudnessMeter::get_integrated() const
+{
+  // blocks above the absolute gate
+  uint64_t count = 0;
+  double power = 0.0;
+  for (size_t bin = 0; bin < hist_size; bin++) {
+    count += hist_counts[bin];
+    power += hist_powers[bin];
+  }
+  if (!count)
+    return -std::numeric_limits<double>::infinity();
+
+  // blocks above the relative gate, from the bin that holds the gate
+  const double gate = power_to_loudness(power / count) + relative_gate;
+  size_t first_bin = 0;
+  if (gate > absolute_gate)
+    first_bin = std::min((size_t)((gate - absolute_gate) * hist_bins_per_lu),
+                         hist_size - 1);
+  count = 0;
+  power = 0.0;
+  for (size_t bin = first_bin; bin < hist_size; bin++) {
+    count += hist_counts[bin];
+    power += hist_powers[bin];
+  }
+
+  return power_to_loudness(power / count);
+}
@@ -0,0 +1,126 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file loudness.hpp
+   \brief sample levels and EBU R128 loudness of frames of a sample stream
+*/
+
+#ifndef LOUDNESS_H
+#define LOUDNESS_H
+
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Levels of a frame of samples
+/** Levels of silence are \c -inf. */
+struct FrameLevels {
+  double rms = 0.0;        ///< RMS level of the frame samples, in dBFS
+  double peak = 0.0;       ///< peak level of the frame samples, in dBFS
+  double momentary = 0.0;  ///< momentary loudness (400 ms), in LUFS
+  double short_term = 0.0; ///< short-term loudness (3 s), in LUFS
+};
+
+/// Measure the levels and loudness of a stream of samples
+/** Loudness is measured as in ITU-R BS.1770-4 and EBU R128. The samples
+ *  of each channel are K-weighted, by a high shelf and a high pass
+ *  biquad filter, and the mean square of the weighted samples, summed
+ *  over the channels, is collected in 100 ms blocks. The momentary and
+ *  short-term loudness of a frame are those of the last 4 and 30 blocks
+ *  at the end of the frame, so they are updated every 100 ms, and the
+ *  blocks before the start of the stream are silent. The integrated
+ *  loudness gates the 400 ms momentary blocks with an absolute gate at
+ *  -70 LUFS and a relative gate 10 LU below the loudness of the blocks
+ *  above the absolute gate. The blocks are counted in a histogram of
+ *  0.1 LU bins, so the memory used does not grow with the stream, and the
+ *  relative gate is applied to within 0.1 LU. The RMS and peak levels of
+ *  a frame are of the unweighted samples of all channels, relative to
+ *  full scale. */
+class LoudnessMeter {
+private:
+  int channels = 0;
+  int channel = 0;         // channel of the next sample
+  size_t block_len = 0;    // sample frames in a 100 ms block
+  size_t block_fill = 0;   // sample frames in the current block
+
+  // K-weighting filter coefficients, high shelf then high pass
+  double shelf_b[3] = {0.0, 0.0, 0.0};
+  double shelf_a[3] = {0.0, 0.0, 0.0};
+  double pass_b[3] = {0.0, 0.0, 0.0};
+  double pass_a[3] = {0.0, 0.0, 0.0};
+  // filter state of each channel, two values for each filter
+  std::vector<double> filter_state;
+
+  double block_sum = 0.0;     // weighted sum of squares of the block
+  std::vector<double> blocks; // mean square of the recent blocks
+  size_t block_idx = 0;       // index in blocks of the next block
+  uint64_t num_blocks = 0;    // blocks completed
+
+  // integrated loudness histogram of the gating blocks
+  std::vector<uint64_t> hist_counts;
+  std::vector<double> hist_powers; // sum of the mean squares in each bin
+
+  double frame_sum = 0.0; // sum of squares of the frame samples
+  double frame_peak = 0.0;
+  size_t frame_samples = 0;
+  FrameLevels frame_levels;
+
+  void end_block();
+  double get_blocks_power(size_t num) const;
+
+public:
+  /// Initialise
+  /**\param rate the sample rate.
+   * \param num_channels the number of interleaved channels, 1 or 2.
+   * \return status, evaluates to \c true if the meter was initialised,
+   *  otherwise \c false.*/
+  Status init(int rate, int num_channels);
+
+  /// Clear the measurements, to measure a new stream
+  void reset();
+
+  /// Add samples
+  /**\param samples interleaved pcm_s16le samples, continuing from the
+   *  samples added before, even if a sample frame is split.
+   * \param num the number of samples. */
+  void add(const int16_t *samples, size_t num);
+
+  /// End a frame
+  /** The levels of the samples added since the end of the last frame can
+   *  then be read with get_frame_levels(). */
+  void end_frame();
+
+  /// Get the levels of the last frame
+  /**\return The levels. */
+  const FrameLevels &get_frame_levels() const { return frame_levels; }
+
+  /// Get the integrated loudness
+  /**\return The loudness of all the samples added, in LUFS, or \c -inf
+   *  if there were no 400 ms blocks above the absolute gate. */
+  double get_integrated() const;
+};
+
+#endif // LOUDNESS_H
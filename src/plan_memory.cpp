@@ -0,0 +1,270 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file plan_memory.cpp
+   \brief memory for cava plans from huge pages local to a NUMA node
+*/
+
+#include "plan_memory.hpp"
+
+extern "C" {
+#include "cavacore/cavacore.h"
+}
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+const size_t region_size = 2 << 20; // huge page size
+const size_t block_align = 64;      // alignment needed by the FFT
+
+struct Region;
+
+// precedes each block, and keeps the block aligned
+struct alignas(block_align) BlockHeader {
+  Region *region; // nullptr if the block is from the heap
+  size_t size;    // including the header
+};
+
+struct Arena;
+
+// a mapped region, its blocks are allocated from its free spans
+struct Region {
+  Arena *arena;
+  char *start;
+  size_t len;
+  size_t num_blocks = 0;               // blocks in use
+  std::map<char *, size_t> free_spans; // start and length, never adjacent
+};
+
+struct Arena {
+  std::mutex arena_mutex;        // blocks may be freed by any thread
+  std::vector<Region *> regions; // in the order they were mapped
+};
+
+// never deleted, the plans of a thread may outlive it
+thread_local Arena *thread_arena = nullptr;
+
+size_t round_up(size_t size, size_t align)
+{
+  return (size + align - 1) / align * align;
+}
+
+char *map_region(size_t len)
+{
+  void *mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (mem == MAP_FAILED) {
+    // map extra to align the region for transparent huge pages
+    size_t map_len = len + region_size;
+    char *raw = (char *)mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED)
+      return nullptr;
+    char *start = (char *)round_up((uintptr_t)raw, region_size);
+    if (start > raw)
+      munmap(raw, start - raw);
+    if (raw + map_len > start + len)
+      munmap(start + len, raw + map_len - (start + len));
+    madvise(start, len, MADV_HUGEPAGE);
+    mem = start;
+  }
+
+  // first touch, places the pages on the node of this thread
+  memset(mem, 0, len);
+  return (char *)mem;
+}
+
+// allocate from the first free span that fits, nullptr if none does
+BlockHeader *region_alloc(Region *region, size_t len)
+{
+  for (auto it = region->free_spans.begin(); it != region->free_spans.end();
+       ++it) {
+    if (it->second < len)
+      continue;
+    char *span = it->first;
+    size_t rest = it->second - len;
+    region->free_spans.erase(it);
+    if (rest)
+      region->free_spans[span + len] = rest;
+    region->num_blocks++;
+    auto *header = (BlockHeader *)span;
+    header->region = region;
+    return header;
+  }
+  return nullptr;
+}
+
+void *arena_alloc(size_t size)
+{
+  Arena *arena = thread_arena;
+  size_t len = sizeof(BlockHeader) + round_up(size, block_align);
+  std::lock_guard<std::mutex> lock(arena->arena_mutex);
+  BlockHeader *header = nullptr;
+  for (Region *region : arena->regions)
+    if ((header = region_alloc(region, len)))
+      break;
+
+  if (!header) {
+    size_t map_len = round_up(len, region_size);
+    char *mem = map_region(map_len);
+    if (!mem) {
+      header = (BlockHeader *)aligned_alloc(block_align, len);
+      if (!header)
+        return nullptr;
+      header->region = nullptr;
+      header->size = len;
+      return header + 1;
+    }
+    auto *region = new Region;
+    region->arena = arena;
+    region->start = mem;
+    region->len = map_len;
+    region->free_spans[mem] = map_len;
+    arena->regions.push_back(region);
+    header = region_alloc(region, len);
+  }
+
+  header->size = len;
+  return header + 1;
+}
+
+void arena_free(void *ptr)
+{
+  if (!ptr)
+    return;
+  BlockHeader *header = (BlockHeader *)ptr - 1;
+  Region *region = header->region;
+  if (!region) {
+    free(header);
+    return;
+  }
+
+  Arena *arena = region->arena;
+  std::lock_guard<std::mutex> lock(arena->arena_mutex);
+  if (--region->num_blocks == 0) {
+    // return the memory of an empty region
+    munmap(region->start, region->len);
+    auto &regions = arena->regions;
+    regions.erase(std::find(regions.begin(), regions.end(), region));
+    delete region;
+    return;
+  }
+
+  // merge the block with the free spans on either side
+  auto &spans = region->free_spans;
+  char *start = (char *)header;
+  size_t len = header->size;
+  auto next = spans.lower_bound(start);
+  if (next != spans.end() && start + len == next->first) {
+    len += next->second;
+    next = spans.erase(next);
+  }
+  if (next != spans.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == start) {
+      start = prev->first;
+      len += prev->second;
+      spans.erase(prev);
+    }
+  }
+  spans[start] = len;
+}
+
+// parse a sysfs list of CPUs, e.g. 0-3,8-11
+std::vector<int> read_cpu_list(const char *file_name)
+{
+  std::vector<int> cpus;
+  FILE *file = fopen(file_name, "r");
+  if (!file)
+    return cpus;
+  int first, last;
+  while (fscanf(file, "%d", &first) == 1) {
+    last = first;
+    int c = fgetc(file);
+    if (c == '-' && fscanf(file, "%d", &last) == 1)
+      c = fgetc(file);
+    for (int cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+    if (c != ',')
+      break;
+  }
+  fclose(file);
+  return cpus;
+}
+}; // namespace
+
+void PlanMemory::use_in_thread()
+{
+  if (!thread_arena)
+    thread_arena = new Arena;
+  cava_set_allocator(arena_alloc, arena_free);
+}
+
+int PlanMemory::get_current_node()
+{
+  unsigned int cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0)
+    return 0;
+  return node;
+}
+
+std::vector<std::vector<int>> PlanMemory::get_node_cpus()
+{
+  std::vector<std::vector<int>> node_cpus;
+  const char *node_dir = "/sys/devices/system/node";
+  DIR *dir = opendir(node_dir);
+  if (!dir)
+    return node_cpus;
+
+  std::map<int, std::vector<int>> nodes;
+  while (struct dirent *entry = readdir(dir)) {
+    int node;
+    char extra;
+    if (sscanf(entry->d_name, "node%d%c", &node, &extra) != 1)
+      continue;
+    std::string file_name =
+        std::string(node_dir) + "/" + entry->d_name + "/cpulist";
+    auto cpus = read_cpu_list(file_name.c_str());
+    if (!cpus.empty())
+      nodes[node] = cpus;
+  }
+  closedir(dir);
+
+  for (auto &node : nodes)
+    node_cpus.push_back(node.second);
+  return node_cpus;
+}
@@ -0,0 +1,66 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file plan_memory.hpp
+   \brief memory for cava plans from huge pages local to a NUMA node
+*/
+
+#ifndef PLAN_MEMORY_H
+#define PLAN_MEMORY_H
+
+#include <vector>
+
+/// Allocate the buffers of cava plans from huge pages
+/** When a server holds many plans, each with many separate buffers, the
+ *  buffers are spread over many pages, and executing the plans in turn
+ *  causes TLB misses. Buffers are instead allocated in order from 2 MiB
+ *  regions. A region is mapped with reserved huge pages (MAP_HUGETLB) if
+ *  there are any, otherwise it is advised as transparent huge pages,
+ *  and if it cannot be mapped the buffers come from the heap. Each thread
+ *  has its own regions, and clears a region when it maps it, so with the
+ *  default NUMA policy the pages are on the node the thread is running
+ *  on. A freed buffer is merged with the free space either side of it,
+ *  and the space is reused for any buffer that fits, and a region is
+ *  unmapped when all of its buffers have been freed. The memory held is
+ *  then that of the regions with buffers of plans that have not been
+ *  destroyed, so it is bounded by the plans a server keeps, and a plan
+ *  destroyed and initialised again with the same parameters takes the
+ *  same space. */
+class PlanMemory {
+public:
+  /// Allocate the plans initialised afterwards by this thread from huge
+  /// pages
+  static void use_in_thread();
+
+  /// Get the NUMA node of the CPU this thread is running on
+  /**\return The node, or \c 0 if it cannot be found. */
+  static int get_current_node();
+
+  /// Get the CPUs of each NUMA node
+  /**\return The CPUs of each node with CPUs, empty if the nodes cannot
+   *  be found. */
+  static std::vector<std::vector<int>> get_node_cpus();
+};
+
+#endif // PLAN_MEMORY_H
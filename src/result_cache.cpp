@@ -0,0 +1,312 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file result_cache.cpp
+   \brief on-disk cache of results, keyed by input content and options
+*/
+
+#include "result_cache.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+namespace {
+
+const uint64_t prime1 = 11400714785074694791ULL;
+const uint64_t prime2 = 14029467366897019727ULL;
+const uint64_t prime3 = 1609587929392839161ULL;
+const uint64_t prime4 = 9650029242287828579ULL;
+const uint64_t prime5 = 2870177450012600261ULL;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+inline uint64_t read64(const unsigned char *p)
+{
+  uint64_t val;
+  memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+inline uint32_t read32(const unsigned char *p)
+{
+  uint32_t val;
+  memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+  acc += input * prime2;
+  acc = rotl(acc, 31);
+  return acc * prime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t val)
+{
+  acc ^= hash_round(0, val);
+  return acc * prime1 + prime4;
+}
+
+const char *entry_suffix = ".cava";
+
+} // namespace
+
+Hash64::Hash64(uint64_t seed_val) : seed(seed_val)
+{
+  acc[0] = seed + prime1 + prime2;
+  acc[1] = seed + prime2;
+  acc[2] = seed;
+  acc[3] = seed - prime1;
+}
+
+void Hash64::update(const void *data, size_t len)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  const unsigned char *end = p + len;
+  total_len += len;
+
+  // complete a partial stripe
+  if (buf_len) {
+    size_t num = std::min(len, sizeof(buf) - buf_len);
+    memcpy(buf + buf_len, p, num);
+    buf_len += num;
+    p += num;
+    if (buf_len < sizeof(buf))
+      return;
+    for (int i = 0; i < 4; i++)
+      acc[i] = hash_round(acc[i], read64(buf + i * 8));
+    buf_len = 0;
+  }
+
+  // whole stripes
+  for (; p + 32 <= end; p += 32)
+    for (int i = 0; i < 4; i++)
+      acc[i] = hash_round(acc[i], read64(p + i * 8));
+
+  // keep the rest for the next update
+  memcpy(buf, p, end - p);
+  buf_len = end - p;
+}
+
+uint64_t Hash64::digest() const
+{
+  uint64_t h;
+  if (total_len >= 32) {
+    h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) +
+        rotl(acc[3], 18);
+    for (int i = 0; i < 4; i++)
+      h = merge_round(h, acc[i]);
+  }
+  else
+    h = seed + prime5;
+
+  h += total_len;
+
+  const unsigned char *p = buf;
+  const unsigned char *end = buf + buf_len;
+  for (; p + 8 <= end; p += 8) {
+    h ^= hash_round(0, read64(p));
+    h = rotl(h, 27) * prime1 + prime4;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t)read32(p) * prime1;
+    h = rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; p++) {
+    h ^= *p * prime5;
+    h = rotl(h, 11) * prime1;
+  }
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+ResultCache::~ResultCache()
+{
+  if (spool_file)
+    fclose(spool_file);
+  if (entry_file) {
+    fclose(entry_file);
+    unlink(entry_tmp_path.c_str());
+  }
+}
+
+Status ResultCache::lookup(FILE *in, const string &options, FILE **input,
+                           bool *found)
+{
+  if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+    return Status::error("could not create cache directory '" + dir +
+                         "': " + strerror(errno));
+
+  // input that cannot be rewound is copied to an unlinked spool file
+  long start_pos = ftell(in);
+  if (start_pos < 0) {
+    string path = dir + "/spool-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0 || !(spool_file = fdopen(fd, "w+")))
+      return Status::error("could not create cache spool file in '" + dir +
+                           "': " + strerror(errno));
+    unlink(path.c_str());
+  }
+
+  Hash64 hash;
+  vector<char> buf(1 << 16);
+  size_t num;
+  while ((num = fread(buf.data(), 1, buf.size(), in)) > 0) {
+    hash.update(buf.data(), num);
+    if (spool_file && fwrite(buf.data(), 1, num, spool_file) < num)
+      return Status::error(string("writing cache spool file: ") +
+                           strerror(errno));
+  }
+  if (ferror(in))
+    return Status::error(string("reading input: ") + strerror(errno));
+
+  if (spool_file) {
+    if (fflush(spool_file) != 0 || fseek(spool_file, 0, SEEK_SET) != 0)
+      return Status::error(string("writing cache spool file: ") +
+                           strerror(errno));
+    *input = spool_file;
+  }
+  else {
+    if (fseek(in, start_pos, SEEK_SET) != 0)
+      return Status::error(string("rewinding input: ") + strerror(errno));
+    *input = in;
+  }
+
+  Hash64 options_hash;
+  options_hash.update(options.data(), options.size());
+  entry_path = dir + "/" +
+               msg_str("%016llx-%016llx", (unsigned long long)hash.digest(),
+                       (unsigned long long)options_hash.digest()) +
+               entry_suffix;
+  *found = access(entry_path.c_str(), R_OK) == 0;
+
+  return Status::ok();
+}
+
+Status ResultCache::read_entry(FILE *out)
+{
+  FILE *entry = fopen(entry_path.c_str(), "r");
+  if (!entry)
+    return Status::error("could not open cache entry '" + entry_path +
+                         "': " + strerror(errno));
+
+  // mark as recently used
+  utime(entry_path.c_str(), nullptr);
+
+  Status stat;
+  vector<char> buf(1 << 16);
+  size_t num;
+  while ((num = fread(buf.data(), 1, buf.size(), entry)) > 0)
+    if (fwrite(buf.data(), 1, num, out) < num) {
+      stat.set_error(string("writing output: ") + strerror(errno));
+      break;
+    }
+  if (stat && ferror(entry))
+    stat.set_error("reading cache entry '" + entry_path +
+                   "': " + strerror(errno));
+
+  fclose(entry);
+  return stat;
+}
+
+Status ResultCache::create_entry(FILE **entry)
+{
+  entry_tmp_path = dir + "/tmp-XXXXXX";
+  int fd = mkstemp(&entry_tmp_path[0]);
+  if (fd < 0 || !(entry_file = fdopen(fd, "w")))
+    return Status::error("could not create cache entry in '" + dir +
+                         "': " + strerror(errno));
+  *entry = entry_file;
+  return Status::ok();
+}
+
+Status ResultCache::close_entry(bool keep)
+{
+  Status stat;
+  if (fclose(entry_file) != 0 && keep)
+    stat.set_error(string("writing cache entry: ") + strerror(errno));
+  entry_file = nullptr;
+
+  if (keep && stat && rename(entry_tmp_path.c_str(), entry_path.c_str()) != 0)
+    stat.set_error("could not add cache entry '" + entry_path +
+                   "': " + strerror(errno));
+  if (!keep || !stat)
+    unlink(entry_tmp_path.c_str());
+
+  return stat;
+}
+
+void ResultCache::evict()
+{
+  DIR *dirp = opendir(dir.c_str());
+  if (!dirp)
+    return;
+
+  struct Entry {
+    string path;
+    off_t size;
+    time_t mtime;
+  };
+  vector<Entry> entries;
+  uint64_t total = 0;
+  const size_t suffix_len = strlen(entry_suffix);
+  while (dirent *ent = readdir(dirp)) {
+    size_t len = strlen(ent->d_name);
+    if (len <= suffix_len ||
+        strcmp(ent->d_name + len - suffix_len, entry_suffix) != 0)
+      continue;
+    struct stat st;
+    string path = dir + "/" + ent->d_name;
+    if (stat(path.c_str(), &st) == 0) {
+      entries.push_back({path, st.st_size, st.st_mtime});
+      total += st.st_size;
+    }
+  }
+  closedir(dirp);
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) { return a.mtime < b.mtime; });
+  for (auto &entry : entries) {
+    if (total <= max_size)
+      break;
+    if (unlink(entry.path.c_str()) == 0)
+      total -= entry.size;
+  }
+}
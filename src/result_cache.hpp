@@ -0,0 +1,125 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file result_cache.hpp
+   \brief on-disk cache of results, keyed by input content and options
+*/
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "status_msg.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/// Streaming 64 bit hash of a sequence of bytes (XXH64)
+class Hash64 {
+private:
+  uint64_t acc[4];
+  unsigned char buf[32];
+  size_t buf_len = 0;
+  uint64_t total_len = 0;
+  uint64_t seed;
+
+public:
+  /// Constructor
+  /**\param seed_val the hash seed. */
+  Hash64(uint64_t seed_val = 0);
+
+  /// Add bytes to the hashed sequence
+  /**\param data the bytes.
+   * \param len the number of bytes. */
+  void update(const void *data, size_t len);
+
+  /// Get the hash of the sequence so far
+  /**\return The hash value. */
+  uint64_t digest() const;
+};
+
+/// On-disk cache of results
+/** An entry is keyed by a hash of the input bytes and a string of the
+ *  options that affect the result. Entries are evicted, least recently
+ *  used first, when the total size of the entries is over the limit. */
+class ResultCache {
+private:
+  std::string dir;
+  uint64_t max_size;
+  std::string entry_path;     // entry for the input looked up
+  std::string entry_tmp_path; // new entry being written
+  FILE *entry_file = nullptr;
+  FILE *spool_file = nullptr; // copy of input that could not be rewound
+
+public:
+  /// Constructor
+  /**\param cache_dir the cache directory, created if it does not exist.
+   * \param max_bytes the total size of entries to keep. */
+  ResultCache(const std::string &cache_dir, uint64_t max_bytes)
+      : dir(cache_dir), max_size(max_bytes)
+  {
+  }
+
+  ResultCache(const ResultCache &) = delete;
+  ResultCache &operator=(const ResultCache &) = delete;
+
+  /// Destructor, removes any spooled input and uncommitted entry
+  ~ResultCache();
+
+  /// Look up the entry for an input
+  /** The input is read to the end to hash it. Input that cannot be
+   *  rewound, like a pipe, is copied to a spool file while it is hashed.
+   * \param in the input.
+   * \param options the options that affect the result.
+   * \param input used to return the input rewound to its start, this is
+   *  \a in or the spool file, which is closed with the cache.
+   * \param found used to return whether there is an entry for the input.
+   * \return status, evaluates to \c true if the input could be hashed,
+   *  otherwise \c false.*/
+  Status lookup(FILE *in, const std::string &options, FILE **input,
+                bool *found);
+
+  /// Copy the entry found by lookup() to a stream
+  /**\param out the stream.
+   * \return status, evaluates to \c true if the entry was copied,
+   *  otherwise \c false.*/
+  Status read_entry(FILE *out);
+
+  /// Create a temporary file to write a new entry to
+  /**\param entry used to return the opened file.
+   * \return status, evaluates to \c true if the file was created,
+   *  otherwise \c false.*/
+  Status create_entry(FILE **entry);
+
+  /// Close the new entry, and make it the entry for the input looked up
+  /**\param keep whether to add the entry to the cache, or discard it.
+   * \return status, evaluates to \c true if the entry was added or
+   *  discarded, otherwise \c false.*/
+  Status close_entry(bool keep = true);
+
+  /// Remove least recently used entries until the cache is within its size
+  void evict();
+};
+
+#endif // RESULT_CACHE_H
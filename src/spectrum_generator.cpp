@@ -0,0 +1,380 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file spectrum_generator.cpp
+   \brief generate frames of spectrum bar values from audio samples
+*/
+
+#include "spectrum_generator.hpp"
+#include "loudness.hpp"
+
+extern "C" {
+#include "cavacore/cavacore_fixed.h"
+}
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace {
+// samples per channel that the sample buffer holds
+const size_t input_len_per_channel = 4096;
+
+// bar value of 1 in the fixed point output
+const double fixed_scale = 1.0 / (1 << CAVA_FIXED_BAR_BITS);
+
+bool is_odd(int num) { return num % 2; }
+}; // namespace
+
+SpectrumGenerator::~SpectrumGenerator() { destroy_fixed_plan(); }
+
+Status SpectrumGenerator::init(const CavaPlanParams &params, double framerate,
+                               CavaPlan *shared_plan,
+                               const SampleConversion &conversion)
+{
+  if (params.channels < 1 || params.channels > 2)
+    return Status::error("invalid number of channels, should be 1 or 2");
+  if (conversion.stereo_downmix && params.channels != 1)
+    return Status::error("a downmix needs a plan with one channel");
+  if (framerate <= 0)
+    return Status::error("framerate must be greater than 0");
+
+  const int input_rate = params.rate * conversion.decimation;
+  Status stat = decimator.init(input_rate, conversion.decimation,
+                               params.high_cut_off, params.channels);
+  if (!stat)
+    return stat;
+
+  destroy_fixed_plan();
+  if (shared_plan) {
+    own_plan.destroy();
+    plan = shared_plan;
+  }
+  else {
+    if (!(stat = own_plan.init(params)))
+      return stat;
+    plan = &own_plan;
+  }
+
+  downmix = conversion.stereo_downmix;
+  channels = downmix ? 2 : params.channels;
+  bars_total = params.bars * params.channels; // total bar vals in cava_out
+
+  // samples buffer len, in samples pushed
+  size_t input_len = input_len_per_channel * channels * conversion.decimation;
+  const double samples_per_frame = (double)(input_rate * channels) / framerate;
+  // + channels sample to ensure being able to hold fractional part of sample
+  execs_per_frame = ceil((samples_per_frame + channels) / input_len);
+  samples_per_exec = samples_per_frame / execs_per_frame;
+  samples_remainder = samples_per_frame - execs_per_frame * samples_per_exec;
+  exec_rate = framerate * execs_per_frame;
+  // estimate the rate, unless set_exact_framerate() is called
+  plan->set_exec_rate(0);
+
+  // Find the fractional part of the sample that would be lost each frame
+  double intpart;
+  sample_fraction_per_frame = modf(samples_per_frame, &intpart);
+  current_accumulated_sample_fractions = 0.0;
+
+  // room for the largest execution, including adjustments
+  input_len = std::max(input_len, (size_t)samples_per_exec + 2 + channels);
+  cava_in.assign(input_len, 0.0);
+  cava_out.assign(bars_total, 0.0);
+  frame_bars.assign(bars_total, 0.0);
+
+  frame_count = 0;
+  frame_samples = 0;
+  exec_samples = 0;
+  exec_idx = 0;
+  start_exec();
+
+  return Status::ok();
+}
+
+void SpectrumGenerator::set_exact_framerate(bool exact)
+{
+  plan->set_exec_rate(exact ? exec_rate : 0);
+}
+
+double SpectrumGenerator::get_settle_time() const
+{
+  // relative difference in the state that no longer changes the output
+  const double tolerance = 1e-6;
+  const cava_plan *p = plan->get();
+
+  // the integral smoothing decays by the noise reduction on each execution
+  double execs = 0.0;
+  if (p->noise_reduction >= 1.0)
+    return std::numeric_limits<double>::infinity();
+  if (p->noise_reduction > 0.0)
+    execs = log(tolerance) / log(p->noise_reduction);
+
+  // the gravity falloff follows the estimate of the execution rate, which
+  // moves 1/64 of the way to the rate on each execution
+  const bool estimated = !fixed_plan && p->fixed_exec_rate <= 0;
+  const double rate_diff =
+      std::fabs(CAVA_INITIAL_FRAMERATE - exec_rate) / exec_rate;
+  if (estimated && p->noise_reduction > 0.1 && rate_diff > tolerance)
+    execs = std::max(execs, log(tolerance / rate_diff) / log(1 - 1.0 / 64));
+
+  return execs / exec_rate;
+}
+
+Status SpectrumGenerator::set_fixed_point(bool fixed)
+{
+  destroy_fixed_plan();
+  if (!fixed)
+    return Status::ok();
+
+  fixed_plan = cava_fixed_init(plan->get(), exec_rate);
+  if (!fixed_plan)
+    return Status::error("fixed point processing does not support autosens "
+                         "or sample rates above 300000");
+  fixed_in.assign(cava_in.size(), 0);
+  fixed_out.assign(bars_total, 0);
+  return Status::ok();
+}
+
+void SpectrumGenerator::destroy_fixed_plan()
+{
+  if (fixed_plan) {
+    cava_fixed_destroy(fixed_plan);
+    free(fixed_plan);
+    fixed_plan = nullptr;
+  }
+}
+
+void SpectrumGenerator::start_exec()
+{
+  if (exec_idx == 0)
+    std::fill(frame_bars.begin(), frame_bars.end(), 0.0);
+
+  // Add 1 to each of the first execs to include the samples remainder
+  exec_len = samples_per_exec + (exec_idx < samples_remainder);
+
+  // ensure that buffer is filled with even number of samples
+  if (channels == 2 && is_odd(exec_len)) {
+    // adjust by one sample, add or subtract on alternate iterations
+    const int offset = is_odd(exec_idx) ? -1 : 1;
+    exec_len += offset;
+    current_accumulated_sample_fractions -= offset; // balance accounts
+  }
+
+  // Add an extra samples if needed to the last exec. There should always
+  // be room for this from the calculation of execs_per_frame
+  if (exec_idx == execs_per_frame - 1) {
+    current_accumulated_sample_fractions += sample_fraction_per_frame;
+    if (current_accumulated_sample_fractions >= channels) {
+      exec_len += channels;
+      current_accumulated_sample_fractions -= channels;
+    }
+  }
+
+  exec_fill = 0;
+  plan_fill = 0;
+}
+
+size_t SpectrumGenerator::fill_exec(const int16_t *samples, size_t num)
+{
+  // convert samples to doubles for cava
+  size_t len = std::min(num, exec_len - exec_fill);
+  if (loudness_meter)
+    loudness_meter->add(samples, len);
+  if (downmix || decimator.get_factor() > 1) {
+    for (size_t i = 0; i < len; i++)
+      convert_sample(samples[i], exec_fill + i);
+  }
+  else {
+    if (fixed_plan)
+      std::copy(samples, samples + len, fixed_in.begin() + exec_fill);
+    else
+      for (size_t i = 0; i < len; i++)
+        cava_in[exec_fill + i] = (int)samples[i];
+    plan_fill += len;
+  }
+  exec_fill += len;
+  return len;
+}
+
+// convert the sample at position pos of the execution
+void SpectrumGenerator::convert_sample(int sample, size_t pos)
+{
+  if (downmix) {
+    // executions have an even number of samples, but a pair may be split
+    // between pushes
+    if (pos % 2 == 0) {
+      mix_first = sample;
+      return;
+    }
+    if (decimator.get_factor() == 1) {
+      if (fixed_plan)
+        fixed_in[plan_fill++] = (mix_first + sample) >> 1;
+      else
+        cava_in[plan_fill++] = (mix_first + sample) / 2.0;
+      return;
+    }
+    add_plan_sample((mix_first + sample) / 2.0);
+  }
+  else
+    add_plan_sample(sample);
+}
+
+// decimate a sample, and add any output to the plan input
+void SpectrumGenerator::add_plan_sample(double sample)
+{
+  double out[2];
+  int num = decimator.add(sample, out);
+  for (int i = 0; i < num; i++) {
+    if (fixed_plan)
+      fixed_in[plan_fill++] =
+          std::max(-32768.0, std::min(32767.0, std::round(out[i])));
+    else
+      cava_in[plan_fill++] = out[i];
+  }
+}
+
+bool SpectrumGenerator::finish_exec()
+{
+  if (fixed_plan) {
+    cava_fixed_execute(fixed_in.data(), plan_fill, fixed_out.data(),
+                       fixed_plan);
+    for (int bar_idx = 0; bar_idx < bars_total; bar_idx++)
+      cava_out[bar_idx] = fixed_out[bar_idx] * fixed_scale;
+  }
+  else // samples are already double, so the plan does not convert them
+    plan->execute(cava_in.data(), plan_fill, cava_out.data());
+  exec_samples += exec_len;
+
+  // add weighted bar values
+  for (int bar_idx = 0; bar_idx < bars_total; bar_idx++)
+    frame_bars[bar_idx] += cava_out[bar_idx] / execs_per_frame;
+
+  exec_idx = (exec_idx + 1) % execs_per_frame;
+  if (exec_idx != 0)
+    return false;
+
+  // frame is complete
+  frame_count++;
+  frame_samples = exec_samples;
+  if (loudness_meter)
+    loudness_meter->end_frame();
+  return true;
+}
+
+size_t SpectrumGenerator::push(const int16_t *samples, size_t num,
+                               double *frames, size_t max_frames,
+                               size_t *num_frames)
+{
+  *num_frames = 0;
+  size_t pos = 0;
+  while (pos < num && *num_frames < max_frames) {
+    pos += fill_exec(samples + pos, num - pos);
+    if (exec_fill == exec_len) {
+      if (finish_exec()) {
+        std::copy(frame_bars.begin(), frame_bars.end(),
+                  frames + *num_frames * bars_total);
+        (*num_frames)++;
+      }
+      start_exec();
+    }
+  }
+
+  return pos;
+}
+
+void SpectrumGenerator::push(const int16_t *samples, size_t num)
+{
+  size_t pos = 0;
+  while (pos < num) {
+    pos += fill_exec(samples + pos, num - pos);
+    if (exec_fill == exec_len) {
+      if (finish_exec() && frame_handler)
+        frame_handler(frame_bars.data());
+      start_exec();
+    }
+  }
+}
+
+void SpectrumGenerator::skip_frames(uint64_t frames)
+{
+  // follow the schedule of finish_exec() and start_exec()
+  while (frames) {
+    exec_samples += exec_len;
+    exec_idx = (exec_idx + 1) % execs_per_frame;
+    if (exec_idx == 0) {
+      frame_count++;
+      frame_samples = exec_samples;
+      frames--;
+    }
+    start_exec();
+  }
+}
+
+void SpectrumGenerator::save_state(std::vector<char> *state) const
+{
+  const size_t header_size = 2 * sizeof(uint64_t) + sizeof(double);
+  state->resize(header_size + plan->get_state_size());
+  char *pos = state->data();
+  memcpy(pos, &frame_count, sizeof(uint64_t));
+  pos += sizeof(uint64_t);
+  memcpy(pos, &frame_samples, sizeof(uint64_t));
+  pos += sizeof(uint64_t);
+  memcpy(pos, &current_accumulated_sample_fractions, sizeof(double));
+  pos += sizeof(double);
+  plan->save_state(pos);
+}
+
+Status SpectrumGenerator::load_state(const std::vector<char> &state)
+{
+  const size_t header_size = 2 * sizeof(uint64_t) + sizeof(double);
+  if (fixed_plan)
+    return Status::error("cannot restore the state of fixed point processing");
+  if (decimator.get_factor() > 1)
+    return Status::error("cannot restore the state of a decimation");
+  if (state.size() != header_size + plan->get_state_size())
+    return Status::error("saved state does not match the generator");
+
+  const char *pos = state.data();
+  memcpy(&frame_count, pos, sizeof(uint64_t));
+  pos += sizeof(uint64_t);
+  memcpy(&frame_samples, pos, sizeof(uint64_t));
+  pos += sizeof(uint64_t);
+  memcpy(&current_accumulated_sample_fractions, pos, sizeof(double));
+  pos += sizeof(double);
+  plan->load_state(pos);
+
+  // continue from the start of the frame after the saved frame
+  exec_samples = frame_samples;
+  exec_idx = 0;
+  start_exec();
+
+  return Status::ok();
+}
+
+const float *SpectrumGenerator::get_cut_off_frequencies() const
+{
+  return plan->get_cut_off_frequencies();
+}
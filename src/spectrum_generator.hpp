@@ -0,0 +1,255 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file spectrum_generator.hpp
+   \brief generate frames of spectrum bar values from audio samples
+*/
+
+#ifndef SPECTRUM_GENERATOR_H
+#define SPECTRUM_GENERATOR_H
+
+#include "cava_plan.hpp"
+#include "decimator.hpp"
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct cava_fixed_plan;
+class LoudnessMeter;
+
+/// Conversion of the samples pushed to a generator for its plan
+struct SampleConversion {
+  /// The samples pushed are stereo, and each pair is mixed to one sample,
+  /// the mean of the left and right, for a plan with one channel. The
+  /// frames then have one channel, for half of the work of a stereo plan.
+  bool stereo_downmix = false;
+  /// The sample rate of the samples pushed is this multiple of the plan
+  /// rate, and they are decimated with a filter that passes frequencies
+  /// up to the high cutoff of the plan (see Decimator).
+  int decimation = 1;
+};
+
+/// Generate frames of spectrum bar values from a stream of samples
+/** Samples are pushed in spans of any size, and each frame is passed to
+ *  a handler, or written to an output buffer, as soon as it is complete.
+ *  The samples for a frame are processed by one or more cava executions,
+ *  and the bar values of the frame are the average of the execution bar
+ *  values. Frames are spaced to keep the given framerate over the whole
+ *  stream, and a final partial frame is not output. */
+class SpectrumGenerator {
+public:
+  /// Frame handler
+  /** Called with the bar values of a frame, the right channel bars (or
+   *  the only channel) followed by the left channel bars. */
+  typedef std::function<void(const double *frame_bars)> FrameHandler;
+
+private:
+  CavaPlan own_plan;
+  CavaPlan *plan = nullptr;
+  int channels = 0;      // channels of the samples pushed
+  bool downmix = false;  // stereo samples are mixed for a mono plan
+  Decimator decimator;
+  int bars_total = 0;
+
+  // frame schedule
+  int execs_per_frame = 0;
+  int samples_per_exec = 0;
+  int samples_remainder = 0;
+  double exec_rate = 0.0; // executions per second
+  double sample_fraction_per_frame = 0.0;
+  double current_accumulated_sample_fractions = 0.0;
+
+  // stream position
+  uint64_t frame_count = 0;   // complete frames
+  uint64_t frame_samples = 0; // samples in complete frames
+  uint64_t exec_samples = 0;  // samples in executions
+
+  // state of the current frame and execution
+  int exec_idx = 0;     // index of the current execution in the frame
+  size_t exec_len = 0;  // samples needed for the current execution
+  size_t exec_fill = 0; // samples collected for the current execution
+  size_t plan_fill = 0; // converted samples for the current execution
+  int mix_first = 0;    // first sample of a downmix pair
+
+  std::vector<double> cava_in;    // double sample buffer
+  std::vector<double> cava_out;   // cava exec bar values
+  std::vector<double> frame_bars; // frame bar values
+
+  // fixed point processing, if set_fixed_point() is called
+  cava_fixed_plan *fixed_plan = nullptr;
+  std::vector<int16_t> fixed_in;  // sample buffer
+  std::vector<int32_t> fixed_out; // cava exec bar values
+  void destroy_fixed_plan();
+
+  FrameHandler frame_handler;
+  LoudnessMeter *loudness_meter = nullptr;
+
+  void start_exec();
+  size_t fill_exec(const int16_t *samples, size_t num);
+  void convert_sample(int sample, size_t pos);
+  void add_plan_sample(double sample);
+  bool finish_exec();
+
+public:
+  /// Constructor
+  SpectrumGenerator() = default;
+  SpectrumGenerator(const SpectrumGenerator &) = delete;
+  SpectrumGenerator &operator=(const SpectrumGenerator &) = delete;
+
+  /// Destructor
+  ~SpectrumGenerator();
+
+  /// Initialise
+  /**\param params the cava plan parameters.
+   * \param framerate the number of frames per second.
+   * \param shared_plan a plan initialised with \a params to use, which must
+   *  outlive the generator. If \c nullptr then the generator initialises
+   *  and owns a plan.
+   * \param conversion the conversion of the samples pushed for the plan.
+   *  The frame schedule, and sample counts such as get_frame_samples(),
+   *  are of the samples pushed.
+   * \return status, evaluates to \c true if the generator was initialised,
+   *  otherwise \c false, e.g. if the plan parameters are not valid.*/
+  Status init(const CavaPlanParams &params, double framerate,
+              CavaPlan *shared_plan = nullptr,
+              const SampleConversion &conversion = SampleConversion());
+
+  /// Use the exact execution rate for the cava smoothing
+  /** By default cava estimates the execution rate from the number of
+   *  samples in each execution, and the estimate depends on the sizes of
+   *  the earlier executions, and settles only after some seconds. With
+   *  the exact rate the smoothing factors are fixed, so a stream that is
+   *  processed in separate parts, or resumed, matches a single pass more
+   *  closely. The output differs slightly from the default.
+   * \param exact whether to use the exact execution rate. */
+  void set_exact_framerate(bool exact);
+
+  /// Get the time for the smoothing to settle
+  /** The smoothing of cava carries state from the earlier input. After
+   *  this time the bar values no longer depend on the state at the start,
+   *  to within rounding, so processing that starts this far before a
+   *  point gives the output of a single pass from that point. The time
+   *  depends on the noise reduction, the execution rate, and whether the
+   *  rate is estimated (see set_exact_framerate()). Call after the
+   *  options are set.
+   * \return The time, in seconds of input, or \c inf if the state never
+   *  settles, with a noise reduction of \c 1. */
+  double get_settle_time() const;
+
+  /// Process the executions with integer arithmetic
+  /** The executions use a fixed point version of the plan (see
+   *  cavacore_fixed.h), which always smooths with the exact execution
+   *  rate. Compared with floating point with the exact rate, the bar
+   *  values differ by at most 4% of the largest bar value, and by 0.5% on
+   *  average, without gravity smoothing, and with it a difference can
+   *  start or stop the fall of a bar, so at most 5% of frames have a bar
+   *  that differs by more than 5% (tested by tests/fixed_point.sh on a
+   *  test signal). Only the executions are fixed point, the average of
+   *  the executions in a frame, a decimation (see SampleConversion) and a
+   *  loudness meter are floating point. Call after init(), which returns
+   *  to floating point. The state of fixed point processing, or of a
+   *  decimation, is not saved by save_state().
+   * \param fixed whether to process in fixed point.
+   * \return status, evaluates to \c true if the processing was set,
+   *  otherwise \c false, and the plan does not support fixed point
+   *  (autosens, or a sample rate above 300000).*/
+  Status set_fixed_point(bool fixed);
+
+  /// Measure the levels and loudness of the samples pushed
+  /** The samples are added to the meter as they are converted for the
+   *  plan, and each frame is ended as it completes, so the levels of a
+   *  frame can be read from the meter in the frame handler, or after
+   *  push() writes the frame.
+   * \param meter the meter, initialised for the samples pushed, which
+   *  must outlive the generator, or \c nullptr to stop measuring. */
+  void set_loudness_meter(LoudnessMeter *meter) { loudness_meter = meter; }
+
+  /// Set the frame handler
+  /**\param handler the function called with each frame. */
+  void set_frame_handler(FrameHandler handler) { frame_handler = handler; }
+
+  /// Push samples, passing complete frames to the frame handler
+  /**\param samples interleaved pcm_s16le samples.
+   * \param num the number of samples. */
+  void push(const int16_t *samples, size_t num);
+
+  /// Push samples, writing complete frames to an output buffer
+  /** Processing stops when the output buffer is full.
+   * \param samples interleaved pcm_s16le samples.
+   * \param num the number of samples.
+   * \param frames the output buffer, frames of get_bars_total() values.
+   * \param max_frames the number of frames the output buffer can hold.
+   * \param num_frames used to return the number of frames written.
+   * \return The number of samples consumed. */
+  size_t push(const int16_t *samples, size_t num, double *frames,
+              size_t max_frames, size_t *num_frames);
+
+  /// Get the number of complete frames
+  /**\return The number of frames. */
+  uint64_t get_frame_count() const { return frame_count; }
+
+  /// Get the number of samples in the complete frames
+  /** At the end of a frame this is the number of samples pushed up to the
+   *  end of the frame.
+   * \return The number of samples. */
+  uint64_t get_frame_samples() const { return frame_samples; }
+
+  /// Skip frames without processing their samples
+  /** Advances the frame schedule as if the samples for the frames had
+   *  been pushed, but without processing them, so the cava state is not
+   *  updated. Only call at the start of a frame, before any of its samples
+   *  are pushed. The number of samples to skip in the stream is then given
+   *  by get_frame_samples().
+   * \param frames the number of frames to skip. */
+  void skip_frames(uint64_t frames);
+
+  /// Save the state of the generator at the end of the last frame
+  /** Only call from the frame handler, the state is that at the end of the
+   *  frame being handled, including the frame and sample counts.
+   * \param state used to return the saved state. */
+  void save_state(std::vector<char> *state) const;
+
+  /// Restore a state saved by save_state()
+  /** The generator must be initialised with the same parameters as the
+   *  saved generator. Pushing the samples that followed the end of the
+   *  saved frame then continues the output of the saved generator.
+   * \param state the saved state.
+   * \return status, evaluates to \c true if the state was restored,
+   *  otherwise \c false.*/
+  Status load_state(const std::vector<char> &state);
+
+  /// Get the total number of bar values in a frame
+  /**\return The number of bars per channel multiplied by the channels. */
+  int get_bars_total() const { return bars_total; }
+
+  /// Get the cut off frequencies of the bars
+  /**\return The lower cutoff frequency of each bar, followed by the
+   *  high cutoff of the last bar. */
+  const float *get_cut_off_frequencies() const;
+};
+
+#endif // SPECTRUM_GENERATOR_H
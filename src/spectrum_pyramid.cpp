@@ -0,0 +1,220 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file spectrum_pyramid.cpp
+   \brief multi-resolution spectrum file, for viewing at many zoom levels
+*/
+
+#include "spectrum_pyramid.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+const char pyramid_magic[8] = {'C', 'A', 'V', 'A', 'P', 'Y', 'R', '1'};
+}; // namespace
+
+Status PyramidWriter::open(const std::string &file_path, int num_bars,
+                           double base_framerate)
+{
+  discard();
+  if (num_bars < 1)
+    return Status::error("pyramid must have at least one bar");
+  path = file_path;
+  bars = num_bars;
+  framerate = base_framerate;
+  write_stat.set_ok();
+  // frame buffers are allocated once, adding a frame only writes to them
+  frame_max_mean.assign(2 * bars, 0.0f);
+  combined.assign(2 * bars, 0.0f);
+
+  // check the file can be written before processing
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file)
+    return Status::error("could not open file for writing '" + path +
+                         "': " + strerror(errno));
+  fclose(file);
+  return Status::ok();
+}
+
+Status PyramidWriter::add_level_frame(size_t level, const float *max_mean)
+{
+  if (level == level_files.size()) {
+    FILE *file = tmpfile();
+    if (!file)
+      return Status::error(std::string("creating pyramid level: ") +
+                           strerror(errno));
+    level_files.push_back(file);
+    level_frames.push_back(0);
+    pending.push_back(std::vector<float>(2 * bars));
+    has_pending.push_back(false);
+  }
+
+  if (fwrite(max_mean, sizeof(float), 2 * bars, level_files[level]) !=
+      2 * bars)
+    return Status::error(std::string("writing pyramid level: ") +
+                         strerror(errno));
+  level_frames[level]++;
+
+  if (!has_pending[level]) {
+    std::copy(max_mean, max_mean + 2 * bars, pending[level].begin());
+    has_pending[level] = true;
+    return Status::ok();
+  }
+
+  // combine with the unpaired frame into a frame of the next level
+  std::vector<float> &prev = pending[level];
+  for (uint32_t i = 0; i < bars; i++) {
+    prev[i] = std::max(prev[i], max_mean[i]);
+    prev[bars + i] = (prev[bars + i] + max_mean[bars + i]) / 2;
+  }
+  has_pending[level] = false;
+  // copy, as the level list may be extended. max_mean may be the previous
+  // combined frame, but it has been used by now
+  std::copy(prev.begin(), prev.end(), combined.begin());
+  return add_level_frame(level + 1, combined.data());
+}
+
+void PyramidWriter::add_frame(const float *frame_bars)
+{
+  if (!write_stat || bars == 0)
+    return;
+  std::copy(frame_bars, frame_bars + bars, frame_max_mean.begin());
+  std::copy(frame_bars, frame_bars + bars, frame_max_mean.begin() + bars);
+  write_stat = add_level_frame(0, frame_max_mean.data());
+}
+
+bool PyramidWriter::next_frame_starts_level() const
+{
+  // level n is started by frame 2^n
+  uint64_t n = level_frames.empty() ? 0 : level_frames[0];
+  return ((n + 1) & n) == 0;
+}
+
+Status PyramidWriter::close()
+{
+  Status stat = write_stat;
+  FILE *file = nullptr;
+  if (stat && !(file = fopen(path.c_str(), "w")))
+    stat.set_error("could not open file for writing '" + path +
+                   "': " + strerror(errno));
+
+  if (stat) {
+    PyramidHeader header;
+    memcpy(header.magic, pyramid_magic, sizeof(header.magic));
+    header.bars = bars;
+    header.num_levels = level_files.size();
+    header.framerate = framerate;
+
+    std::vector<PyramidLevel> index(level_files.size());
+    uint64_t offset = sizeof(header) + index.size() * sizeof(PyramidLevel);
+    for (size_t i = 0; i < index.size(); i++) {
+      index[i].offset = offset;
+      index[i].num_frames = level_frames[i];
+      offset += level_frames[i] * 2 * bars * sizeof(float);
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(index.data(), sizeof(PyramidLevel), index.size(),
+                     file) == index.size();
+    std::vector<char> buf(1 << 16);
+    for (size_t i = 0; ok && i < level_files.size(); i++) {
+      rewind(level_files[i]);
+      size_t num;
+      while (ok && (num = fread(buf.data(), 1, buf.size(), level_files[i])))
+        ok = fwrite(buf.data(), 1, num, file) == num;
+      ok = ok && !ferror(level_files[i]);
+    }
+    if (fclose(file) != 0 || !ok)
+      stat.set_error("writing '" + path + "': " + strerror(errno));
+  }
+
+  discard();
+  return stat;
+}
+
+void PyramidWriter::discard()
+{
+  for (auto file : level_files)
+    fclose(file);
+  level_files.clear();
+  level_frames.clear();
+  pending.clear();
+  has_pending.clear();
+}
+
+Status PyramidReader::open(const std::string &file_path)
+{
+  close();
+  int fd = ::open(file_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return Status::error("could not open file for reading '" + file_path +
+                         "': " + strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(PyramidHeader)) {
+    map_size = st.st_size;
+    map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+      map = nullptr;
+  }
+  ::close(fd);
+  if (!map)
+    return Status::error("could not map file '" + file_path + "'");
+
+  // check that the header and levels lie within the file
+  header = (const PyramidHeader *)map;
+  levels = (const PyramidLevel *)(header + 1);
+  bool valid = memcmp(header->magic, pyramid_magic, sizeof(pyramid_magic)) ==
+                   0 &&
+               header->bars > 0 &&
+               header->num_levels <=
+                   (map_size - sizeof(PyramidHeader)) / sizeof(PyramidLevel);
+  for (uint32_t i = 0; valid && i < header->num_levels; i++) {
+    uint64_t frame_size = 2 * header->bars * sizeof(float);
+    valid = levels[i].offset <= map_size &&
+            levels[i].num_frames <=
+                (map_size - levels[i].offset) / frame_size;
+  }
+  if (!valid) {
+    close();
+    return Status::error("not a valid pyramid file '" + file_path + "'");
+  }
+
+  return Status::ok();
+}
+
+void PyramidReader::close()
+{
+  if (map)
+    munmap(map, map_size);
+  map = nullptr;
+  map_size = 0;
+  header = nullptr;
+  levels = nullptr;
+}
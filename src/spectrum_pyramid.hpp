@@ -0,0 +1,202 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file spectrum_pyramid.hpp
+   \brief multi-resolution spectrum file, for viewing at many zoom levels
+*/
+
+#ifndef SPECTRUM_PYRAMID_H
+#define SPECTRUM_PYRAMID_H
+
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/// Layout of a spectrum pyramid file
+/** A pyramid file holds the frames of bar values at the base framerate
+ *  (level 0), and at levels with half the framerate of the level below.
+ *  A frame of a higher level covers two frames of the level below, and
+ *  holds the maximum and the mean of each bar over those frames. A final
+ *  unpaired frame of a level does not contribute to the level above.
+ *
+ *  The file, in native byte order, is a PyramidHeader, followed by a
+ *  PyramidLevel for each level, followed by the level data. The data for
+ *  a level is its frames, each frame being \c bars maximum values followed
+ *  by \c bars mean values, as \c float. The maximum and mean values of a
+ *  level 0 frame are the same. */
+struct PyramidHeader {
+  char magic[8];       ///< "CAVAPYR1"
+  uint32_t bars;       ///< the number of bar values in a frame
+  uint32_t num_levels; ///< the number of levels
+  double framerate;    ///< the framerate of level 0
+};
+
+/// Index entry for a level of a spectrum pyramid file
+struct PyramidLevel {
+  uint64_t offset;     ///< file offset of the first frame of the level
+  uint64_t num_frames; ///< number of frames in the level
+};
+
+/// Write a spectrum pyramid file
+/** The frames are added at the base framerate, and all the levels are
+ *  generated in the same pass. The level data is held in temporary
+ *  files until the pyramid file is written by close(). */
+class PyramidWriter {
+private:
+  std::string path;
+  uint32_t bars = 0;
+  double framerate = 0;
+  std::vector<FILE *> level_files;         // level frames, before close()
+  std::vector<uint64_t> level_frames;      // number of frames in each level
+  std::vector<std::vector<float>> pending; // unpaired frame of each level
+  std::vector<bool> has_pending;           // whether there is a pending frame
+  std::vector<float> frame_max_mean;       // added frame, as a level frame
+  std::vector<float> combined;             // frame passed to the next level
+  Status write_stat;
+
+  Status add_level_frame(size_t level, const float *max_mean);
+  void discard();
+
+public:
+  /// Constructor
+  PyramidWriter() = default;
+  PyramidWriter(const PyramidWriter &) = delete;
+  PyramidWriter &operator=(const PyramidWriter &) = delete;
+
+  /// Destructor
+  /** Discards the pyramid if close() was not called. */
+  ~PyramidWriter() { discard(); }
+
+  /// Start a pyramid
+  /**\param file_path the pyramid file path.
+   * \param num_bars the number of bar values in a frame.
+   * \param base_framerate the framerate of the frames that are added.
+   * \return status, evaluates to \c true if the pyramid was started,
+   *  otherwise \c false.*/
+  Status open(const std::string &file_path, int num_bars,
+              double base_framerate);
+
+  /// Add a frame
+  /** Errors are reported by close().
+   * \param frame_bars the bar values of the frame. */
+  void add_frame(const float *frame_bars);
+
+  /// Whether adding the next frame starts a new level
+  /** Only starting a level allocates memory, and this happens each time
+   *  the number of frames doubles.
+   * \return \c true if the next frame starts a level. */
+  bool next_frame_starts_level() const;
+
+  /// Write the pyramid file
+  /**\return status, evaluates to \c true if the file was written,
+   *  otherwise \c false.*/
+  Status close();
+};
+
+/// Read a spectrum pyramid file
+/** The file is mapped into memory, and any frame of any level is found
+ *  directly from the level index. */
+class PyramidReader {
+private:
+  void *map = nullptr;
+  size_t map_size = 0;
+  const PyramidHeader *header = nullptr;
+  const PyramidLevel *levels = nullptr;
+
+public:
+  /// Constructor
+  PyramidReader() = default;
+  PyramidReader(const PyramidReader &) = delete;
+  PyramidReader &operator=(const PyramidReader &) = delete;
+
+  /// Destructor
+  ~PyramidReader() { close(); }
+
+  /// Open a pyramid file
+  /**\param file_path the pyramid file path.
+   * \return status, evaluates to \c true if the file was opened,
+   *  otherwise \c false.*/
+  Status open(const std::string &file_path);
+
+  /// Close the pyramid file
+  void close();
+
+  /// Get the number of bar values in a frame
+  /**\return The number of bars. */
+  int get_bars() const { return header->bars; }
+
+  /// Get the number of levels
+  /**\return The number of levels. */
+  int get_num_levels() const { return header->num_levels; }
+
+  /// Get the number of frames in a level
+  /**\param level the level.
+   * \return The number of frames. */
+  uint64_t get_num_frames(int level) const
+  {
+    return levels[level].num_frames;
+  }
+
+  /// Get the framerate of a level
+  /**\param level the level.
+   * \return The framerate. */
+  double get_framerate(int level) const
+  {
+    return header->framerate / ((uint64_t)1 << level);
+  }
+
+  /// Get the frame of a level that includes a time
+  /**\param level the level.
+   * \param secs the time, in seconds from the start.
+   * \return The frame index, which may be past the last frame. */
+  uint64_t get_frame_at(int level, double secs) const
+  {
+    return secs > 0 ? (uint64_t)(secs * get_framerate(level)) : 0;
+  }
+
+  /// Get the maximum bar values of a frame
+  /**\param level the level.
+   * \param frame the frame index.
+   * \return The bar values. */
+  const float *get_max_bars(int level, uint64_t frame) const
+  {
+    return (const float *)((const char *)map + levels[level].offset) +
+           frame * 2 * header->bars;
+  }
+
+  /// Get the mean bar values of a frame
+  /**\param level the level.
+   * \param frame the frame index.
+   * \return The bar values. */
+  const float *get_mean_bars(int level, uint64_t frame) const
+  {
+    return get_max_bars(level, frame) + header->bars;
+  }
+};
+
+#endif // SPECTRUM_PYRAMID_H
@@ -0,0 +1,459 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file uring_io.cpp
+   \brief file input and output with asynchronous io_uring requests
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "uring_io.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#if HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/// Minimal io_uring, using the system calls directly
+/** The caller keeps no more requests in flight than the ring entries. */
+class IoUring {
+private:
+  int fd = -1;
+  void *sq_ring = MAP_FAILED;
+  void *cq_ring = MAP_FAILED;
+  size_t sq_ring_size = 0;
+  size_t cq_ring_size = 0;
+  struct io_uring_sqe *sqes = (struct io_uring_sqe *)MAP_FAILED;
+  size_t sqes_size = 0;
+
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_mask = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned *cq_mask = nullptr;
+  struct io_uring_cqe *cqes = nullptr;
+  unsigned to_submit = 0;
+
+public:
+  IoUring() = default;
+  IoUring(const IoUring &) = delete;
+  IoUring &operator=(const IoUring &) = delete;
+  ~IoUring();
+
+  Status init(unsigned entries);
+
+  // queue a read or write, submitted by submit() or wait()
+  void queue(int op, int file_fd, char *buf, size_t len, uint64_t offset,
+             uint64_t user_data);
+  Status submit();
+  // wait for a completion
+  Status wait(struct io_uring_cqe *cqe);
+};
+
+IoUring::~IoUring()
+{
+  if (sqes != MAP_FAILED)
+    munmap(sqes, sqes_size);
+  if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+    munmap(cq_ring, cq_ring_size);
+  if (sq_ring != MAP_FAILED)
+    munmap(sq_ring, sq_ring_size);
+  if (fd >= 0)
+    close(fd);
+}
+
+Status IoUring::init(unsigned entries)
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (fd < 0)
+    return Status::error(std::string("io_uring setup: ") + strerror(errno));
+
+  sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+  sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ring == MAP_FAILED)
+    return Status::error(std::string("io_uring map: ") + strerror(errno));
+  if (single_mmap)
+    cq_ring = sq_ring;
+  else {
+    cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED)
+      return Status::error(std::string("io_uring map: ") + strerror(errno));
+  }
+  sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes = (struct io_uring_sqe *)mmap(nullptr, sqes_size,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_SHARED | MAP_POPULATE, fd,
+                                     IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+    return Status::error(std::string("io_uring map: ") + strerror(errno));
+
+  char *sq = (char *)sq_ring;
+  sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  sq_array = (unsigned *)(sq + params.sq_off.array);
+  char *cq = (char *)cq_ring;
+  cq_head = (unsigned *)(cq + params.cq_off.head);
+  cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+  return Status::ok();
+}
+
+void IoUring::queue(int op, int file_fd, char *buf, size_t len,
+                    uint64_t offset, uint64_t user_data)
+{
+  // only this thread adds entries, so the tail can be read directly
+  unsigned tail = *sq_tail;
+  unsigned idx = tail & *sq_mask;
+  struct io_uring_sqe *sqe = &sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->fd = file_fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  sq_array[idx] = idx;
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  to_submit++;
+}
+
+Status IoUring::submit()
+{
+  while (to_submit) {
+    int ret = syscall(__NR_io_uring_enter, fd, to_submit, 0, 0, nullptr, 0);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      return Status::error(std::string("io_uring submit: ") +
+                           strerror(errno));
+    }
+    to_submit -= ret;
+  }
+  return Status::ok();
+}
+
+Status IoUring::wait(struct io_uring_cqe *cqe)
+{
+  Status stat = submit();
+  if (!stat)
+    return stat;
+
+  // only this thread removes completions, so the head can be read directly
+  unsigned head = *cq_head;
+  while (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+    int ret = syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS,
+                      nullptr, 0);
+    if (ret < 0 && errno != EINTR)
+      return Status::error(std::string("io_uring wait: ") + strerror(errno));
+  }
+  *cqe = cqes[head & *cq_mask];
+  __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+
+  return Status::ok();
+}
+
+#else // !HAVE_IO_URING
+
+class IoUring {
+};
+
+#endif // HAVE_IO_URING
+
+UringReader::~UringReader()
+{
+#if HAVE_IO_URING
+  // the kernel may still be writing to the buffers
+  if (ring)
+    for (auto &block : blocks)
+      while (block.in_flight && wait_one())
+        ;
+#endif // HAVE_IO_URING
+  for (auto &block : blocks)
+    free(block.buf);
+  delete ring;
+}
+
+#if HAVE_IO_URING
+
+Status UringReader::submit(size_t idx)
+{
+  Block &block = blocks[idx];
+  block.in_flight = true;
+  ring->queue(IORING_OP_READ, fd, block.buf + block.fill,
+              block_size - block.fill, block.offset + block.fill, idx);
+  return Status::ok();
+}
+
+Status UringReader::wait_one()
+{
+  struct io_uring_cqe cqe;
+  Status stat = ring->wait(&cqe);
+  if (!stat)
+    return stat;
+
+  Block &block = blocks[cqe.user_data];
+  block.in_flight = false;
+  if (cqe.res < 0)
+    return Status::error(std::string("reading input: ") +
+                         strerror(-cqe.res));
+  if (cqe.res == 0)
+    at_end = true;
+  else {
+    block.fill += cqe.res;
+    if (block.fill < block_size)
+      submit(cqe.user_data); // short read, request the rest
+  }
+
+  return Status::ok();
+}
+
+Status UringReader::init(int file_fd, uint64_t offset, size_t block_len,
+                         unsigned depth)
+{
+  ring = new IoUring;
+  Status stat = ring->init(depth);
+  if (!stat)
+    return stat;
+
+  fd = file_fd;
+  block_size = block_len;
+  blocks.resize(depth);
+  for (auto &block : blocks)
+    if (posix_memalign((void **)&block.buf, 4096, block_size) != 0)
+      return Status::error("could not allocate read buffers");
+
+  next_offset = offset;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    blocks[i].offset = next_offset;
+    next_offset += block_size;
+    submit(i);
+  }
+  cur = 0;
+  cur_returned = false;
+  at_end = false;
+
+  return ring->submit();
+}
+
+Status UringReader::read(const char **data, size_t *len)
+{
+  Status stat;
+  if (cur_returned) {
+    // reuse the block that was returned for the next request
+    Block &block = blocks[cur];
+    block.fill = 0;
+    block.offset = next_offset;
+    next_offset += block_size;
+    if (!at_end)
+      submit(cur);
+    cur = (cur + 1) % blocks.size();
+    cur_returned = false;
+  }
+
+  Block &block = blocks[cur];
+  while (block.in_flight)
+    if (!(stat = wait_one()))
+      return stat;
+
+  *data = block.buf;
+  *len = block.fill;
+  cur_returned = true;
+  return Status::ok();
+}
+
+namespace {
+
+// stream that writes blocks asynchronously
+struct UringWriter {
+  struct Block {
+    char *buf = nullptr;
+    uint64_t offset = 0; // file offset of the block
+    size_t fill = 0;     // bytes in the block
+    size_t written = 0;  // bytes written to the file
+    bool in_flight = false;
+  };
+
+  IoUring ring;
+  int fd = -1;
+  size_t block_size = 0;
+  std::vector<Block> blocks;
+  size_t cur = 0;       // index of the block being filled
+  uint64_t offset = 0;  // file offset of the block being filled
+  int error_num = 0;    // first write error
+
+  ~UringWriter()
+  {
+    for (auto &block : blocks)
+      free(block.buf);
+  }
+
+  void submit(size_t idx)
+  {
+    Block &block = blocks[idx];
+    block.in_flight = true;
+    ring.queue(IORING_OP_WRITE, fd, block.buf + block.written,
+               block.fill - block.written, block.offset + block.written, idx);
+  }
+
+  bool wait_one()
+  {
+    struct io_uring_cqe cqe;
+    if (!ring.wait(&cqe)) {
+      error_num = errno;
+      return false;
+    }
+    Block &block = blocks[cqe.user_data];
+    block.in_flight = false;
+    if (cqe.res <= 0) {
+      if (!error_num)
+        error_num = cqe.res ? -cqe.res : EIO;
+      return true;
+    }
+    block.written += cqe.res;
+    if (block.written < block.fill)
+      submit(cqe.user_data); // short write, write the rest
+    return true;
+  }
+
+  // write the block being filled, and move to a free block
+  bool flush_block()
+  {
+    Block &block = blocks[cur];
+    if (block.fill == 0)
+      return true;
+    block.offset = offset;
+    block.written = 0;
+    offset += block.fill;
+    submit(cur);
+    cur = (cur + 1) % blocks.size();
+    while (blocks[cur].in_flight)
+      if (!wait_one())
+        return false;
+    blocks[cur].fill = 0;
+    return error_num == 0;
+  }
+};
+
+ssize_t uring_stream_write(void *cookie, const char *buf, size_t size)
+{
+  auto writer = (UringWriter *)cookie;
+  size_t pos = 0;
+  while (pos < size) {
+    UringWriter::Block &block = writer->blocks[writer->cur];
+    size_t len = std::min(size - pos, writer->block_size - block.fill);
+    memcpy(block.buf + block.fill, buf + pos, len);
+    block.fill += len;
+    pos += len;
+    if (block.fill == writer->block_size && !writer->flush_block()) {
+      errno = writer->error_num;
+      return -1;
+    }
+  }
+  return size;
+}
+
+int uring_stream_close(void *cookie)
+{
+  auto writer = (UringWriter *)cookie;
+  writer->flush_block();
+  for (auto &block : writer->blocks)
+    while (block.in_flight && writer->wait_one())
+      ;
+  int error_num = writer->error_num;
+  if (close(writer->fd) != 0 && !error_num)
+    error_num = errno;
+  delete writer;
+  if (error_num) {
+    errno = error_num;
+    return -1;
+  }
+  return 0;
+}
+
+}; // namespace
+
+FILE *open_uring_write_stream(int fd, size_t block_len, unsigned depth)
+{
+  off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (offset < 0)
+    return nullptr;
+
+  auto writer = new UringWriter;
+  writer->fd = fd;
+  writer->offset = offset;
+  writer->block_size = block_len;
+  writer->blocks.resize(depth);
+  bool ok = writer->ring.init(depth).is_ok();
+  for (auto &block : writer->blocks)
+    ok = ok && posix_memalign((void **)&block.buf, 4096, block_len) == 0;
+
+  FILE *strm = nullptr;
+  if (ok) {
+    cookie_io_functions_t funcs = {nullptr, uring_stream_write, nullptr,
+                                   uring_stream_close};
+    strm = fopencookie(writer, "w", funcs);
+  }
+  if (!strm)
+    delete writer;
+  return strm;
+}
+
+#else // !HAVE_IO_URING
+
+Status UringReader::init(int, uint64_t, size_t, unsigned)
+{
+  return Status::error("io_uring is not supported by this build");
+}
+
+Status UringReader::read(const char **, size_t *)
+{
+  return Status::error("io_uring is not supported by this build");
+}
+
+FILE *open_uring_write_stream(int, size_t, unsigned) { return nullptr; }
+
+#endif // HAVE_IO_URING
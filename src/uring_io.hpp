@@ -0,0 +1,110 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/*!\file uring_io.hpp
+   \brief file input and output with asynchronous io_uring requests
+*/
+
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include "status_msg.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class IoUring;
+
+/// Read a file in order with several large reads in flight
+/** Requires io_uring support at build time and run time, otherwise
+ *  init() returns an error and the caller should read the file another
+ *  way. */
+class UringReader {
+private:
+  struct Block {
+    char *buf = nullptr;
+    uint64_t offset = 0;  // file offset of the block
+    size_t fill = 0;      // bytes read into the block
+    bool in_flight = false;
+  };
+
+  IoUring *ring = nullptr;
+  int fd = -1;
+  size_t block_size = 0;
+  std::vector<Block> blocks;
+  size_t cur = 0;               // index of the next block to return
+  bool cur_returned = false;    // the next read() reuses the current block
+  uint64_t next_offset = 0;     // file offset of the next block to request
+  bool at_end = false;          // a read reached the end of the file
+
+  Status submit(size_t idx);
+  Status wait_one();
+
+public:
+  /// Constructor
+  UringReader() = default;
+  UringReader(const UringReader &) = delete;
+  UringReader &operator=(const UringReader &) = delete;
+
+  /// Destructor
+  /** Waits for any reads in flight. */
+  ~UringReader();
+
+  /// Initialise
+  /**\param file_fd the file descriptor, which must remain open while
+   *  reading.
+   * \param offset the file offset to start reading from.
+   * \param block_len the number of bytes in each read.
+   * \param depth the number of reads in flight.
+   * \return status, evaluates to \c true if reading was started,
+   *  otherwise \c false.*/
+  Status init(int file_fd, uint64_t offset, size_t block_len = 1 << 20,
+              unsigned depth = 4);
+
+  /// Read the next block
+  /** The data is valid until the next call.
+   * \param data used to return the block data.
+   * \param len used to return the number of bytes in the block, which is
+   *  less than the block length only at the end of the file, and \c 0 when
+   *  there is no more data.
+   * \return status, evaluates to \c true if the block was read,
+   *  otherwise \c false.*/
+  Status read(const char **data, size_t *len);
+};
+
+/// Open a stream that writes to a file with asynchronous writes
+/** Data is written to the file in large blocks, from the current offset,
+ *  with several writes in flight. Closing the stream waits for the
+ *  writes, closes \a fd, and reports any write error.
+ * \param fd the file descriptor, which is owned by the stream.
+ * \param block_len the number of bytes in each write.
+ * \param depth the number of writes in flight.
+ * \return The stream, or \c nullptr if io_uring is not available, and
+ *  then \a fd is not closed. */
+FILE *open_uring_write_stream(int fd, size_t block_len = 1 << 18,
+                              unsigned depth = 4);
+
+#endif // URING_IO_H
@@ -0,0 +1,33 @@
+#!/bin/sh
+# no heap allocations in the frame loop, with cava_filter_alloc_check, which
+# fails if any allocation is made after the first frame
+
+. "${srcdir:-.}/test_common.sh"
+
+CAVA_FILTER=../src/cava_filter_alloc_check
+
+$MAKE_INPUT -d 20 > "$tmp_dir/in.raw" || exit 99
+$MAKE_INPUT -d 5 -r 176400 > "$tmp_dir/in176.raw" || exit 99
+
+# a file, read in large blocks
+run -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -S -f 60 -b 30 -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+
+# a pipe, read in small blocks
+echo "cat | cava_filter"
+cat "$tmp_dir/in.raw" | $CAVA_FILTER -o "$tmp_dir/out.txt" ||
+  fail "cat | cava_filter"
+
+# the other stages of the frame loop
+run -M -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -X -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -E -n 0.8 -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -l -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -L "$tmp_dir/levels.txt" -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -P "$tmp_dir/out.pyr" -I "$tmp_dir/out.idx" -o "$tmp_dir/out.txt" \
+  "$tmp_dir/in.raw"
+run -s 5 -d 10 -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -U -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+run -r -R 176400 -o "$tmp_dir/out.txt" "$tmp_dir/in176.raw"
+
+exit 0
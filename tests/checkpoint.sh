@@ -0,0 +1,32 @@
+#!/bin/sh
+# a run with checkpoints (-k) that is killed and resumed, compared with the
+# output of an uninterrupted run
+
+. "${srcdir:-.}/test_common.sh"
+
+$MAKE_INPUT -d 100 > "$tmp_dir/in.raw" || exit 99
+
+for opts in "-n 0.8" "-n 0.8 -E"; do
+  run $opts -o "$tmp_dir/ref.txt" "$tmp_dir/in.raw"
+
+  # kill the run once it has saved a checkpoint
+  rm -f "$tmp_dir/out.txt"
+  echo "cava_filter $opts -k ... (killed)"
+  $CAVA_FILTER $opts -k "$tmp_dir/checkpoint,20" -o "$tmp_dir/out.txt" \
+    "$tmp_dir/in.raw" &
+  pid=$!
+  while [ ! -f "$tmp_dir/checkpoint" ] && kill -0 $pid 2>/dev/null; do
+    sleep 0.05
+  done
+  kill -9 $pid 2>/dev/null
+  wait $pid 2>/dev/null
+  [ -f "$tmp_dir/checkpoint" ] || fail "no checkpoint was saved"
+
+  run $opts -k "$tmp_dir/checkpoint,20" -o "$tmp_dir/out.txt" "$tmp_dir/in.raw"
+  [ ! -f "$tmp_dir/checkpoint" ] || fail "checkpoint was not removed"
+
+  # the resumed run continues exactly as the uninterrupted run
+  cmp "$tmp_dir/ref.txt" "$tmp_dir/out.txt" || fail "resumed output differs"
+done
+
+exit 0
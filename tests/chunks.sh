@@ -0,0 +1,24 @@
+#!/bin/sh
+# chunks (-x) with the default warm-up time joined by cava_filter_merge,
+# compared with the output for the whole input
+
+. "${srcdir:-.}/test_common.sh"
+
+MERGE=../src/cava_filter_merge
+
+$MAKE_INPUT -d 100 > "$tmp_dir/in.raw" || exit 99
+
+for opts in "-n 0.8" "-n 0.8 -f 60" "-n 0.8 -E"; do
+  run $opts -o "$tmp_dir/ref.txt" "$tmp_dir/in.raw"
+  for i in 0 1 2 3; do
+    run $opts -x $i,4 -o "$tmp_dir/chunk$i.txt" "$tmp_dir/in.raw"
+  done
+  $MERGE -o "$tmp_dir/merged.txt" "$tmp_dir"/chunk[0-3].txt ||
+    fail "cava_filter_merge"
+
+  # the smoothing has settled to within rounding, so only a few frames
+  # may differ, by 1
+  compare -m 0.5 -f 0,0.5 "$tmp_dir/ref.txt" "$tmp_dir/merged.txt"
+done
+
+exit 0
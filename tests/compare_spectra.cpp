@@ -0,0 +1,220 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file compare_spectra.cpp
+   \brief compare two cava_filter outputs, and check the differences
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+void usage(const char *name)
+{
+  fprintf(stderr, R"(
+Usage: %s [options] ref_file file
+
+Compare the bar values of a cava_filter output with a reference output of
+the same input, print statistics of the differences, and exit with status
+1 if a limit given in the options is exceeded. Differences are percentages
+of the largest bar value of the reference.
+
+  Options
+  -s <lo,hi> the sum of the bar values must differ from the reference sum
+             by lo to hi percent (negative if lower)
+  -m <pct>   the largest difference of a bar value
+  -a <pct>   the mean difference of a bar value
+  -f <p,fr>  the percentage of frames with a bar value that differs by more
+             than p percent must be at most fr
+
+)",
+          name);
+}
+
+// read the bar values of each line of a file
+bool read_frames(const char *file_name, std::vector<std::vector<int>> *frames)
+{
+  FILE *file = fopen(file_name, "r");
+  if (!file) {
+    perror(file_name);
+    return false;
+  }
+  std::string line;
+  int c = 0;
+  while (c != EOF) {
+    line.clear();
+    while ((c = fgetc(file)) != EOF && c != '\n')
+      line.push_back(c);
+    std::vector<int> bars;
+    const char *p = line.c_str();
+    char *end;
+    while (true) {
+      long val = strtol(p, &end, 10);
+      if (end == p)
+        break;
+      bars.push_back(val);
+      p = end;
+    }
+    if (!bars.empty())
+      frames->push_back(bars);
+  }
+  bool ok = !ferror(file);
+  if (!ok)
+    perror(file_name);
+  fclose(file);
+  return ok;
+}
+
+bool read_pair(const char *str, double *first, double *second)
+{
+  char *end;
+  *first = strtod(str, &end);
+  if (end == str || *end != ',')
+    return false;
+  const char *p = end + 1;
+  *second = strtod(p, &end);
+  return end != p && *end == '\0';
+}
+
+bool read_num(const char *str, double *num)
+{
+  char *end;
+  *num = strtod(str, &end);
+  return end != str && *end == '\0';
+}
+}; // namespace
+
+int main(int argc, char *argv[])
+{
+  bool check_sum = false;
+  double sum_lo = 0.0;
+  double sum_hi = 0.0;
+  double max_limit = -1.0;
+  double mean_limit = -1.0;
+  double frame_diff = -1.0;
+  double frame_limit = 0.0;
+
+  int c;
+  bool ok = true;
+  while ((c = getopt(argc, argv, "s:m:a:f:")) != -1) {
+    switch (c) {
+    case 's':
+      ok &= check_sum = read_pair(optarg, &sum_lo, &sum_hi);
+      break;
+    case 'm':
+      ok &= read_num(optarg, &max_limit);
+      break;
+    case 'a':
+      ok &= read_num(optarg, &mean_limit);
+      break;
+    case 'f':
+      ok &= read_pair(optarg, &frame_diff, &frame_limit);
+      break;
+    default:
+      ok = false;
+    }
+  }
+  if (!ok || argc - optind != 2) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<std::vector<int>> ref_frames;
+  std::vector<std::vector<int>> frames;
+  if (!read_frames(argv[optind], &ref_frames) ||
+      !read_frames(argv[optind + 1], &frames))
+    return 2;
+  if (frames.size() != ref_frames.size()) {
+    fprintf(stderr, "number of frames differ: %zu and %zu\n",
+            ref_frames.size(), frames.size());
+    return 1;
+  }
+
+  int ref_max = 1;
+  for (const auto &bars : ref_frames)
+    for (int val : bars)
+      ref_max = std::max(ref_max, val);
+
+  double ref_sum = 0.0;
+  double sum = 0.0;
+  double max_diff = 0.0;
+  double sum_diff = 0.0;
+  size_t num_bars = 0;
+  size_t frames_differing = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    if (frames[i].size() != ref_frames[i].size()) {
+      fprintf(stderr, "number of bars differ in frame %zu\n", i);
+      return 1;
+    }
+    bool differs = false;
+    for (size_t j = 0; j < frames[i].size(); j++) {
+      ref_sum += ref_frames[i][j];
+      sum += frames[i][j];
+      const double diff =
+          100.0 * abs(frames[i][j] - ref_frames[i][j]) / ref_max;
+      max_diff = std::max(max_diff, diff);
+      sum_diff += diff;
+      differs |= frame_diff >= 0 && diff > frame_diff;
+    }
+    num_bars += frames[i].size();
+    frames_differing += differs;
+  }
+
+  const double sum_change = ref_sum ? 100.0 * (sum - ref_sum) / ref_sum : 0.0;
+  const double mean_diff = num_bars ? sum_diff / num_bars : 0.0;
+  const double frames_pct =
+      frames.size() ? 100.0 * frames_differing / frames.size() : 0.0;
+  printf("frames:    %zu\n", frames.size());
+  printf("sum:       %+.2f%%\n", sum_change);
+  printf("max diff:  %.2f%%\n", max_diff);
+  printf("mean diff: %.3f%%\n", mean_diff);
+  if (frame_diff >= 0)
+    printf("frames differing by more than %g%%: %.2f%%\n", frame_diff,
+           frames_pct);
+
+  ok = true;
+  if (check_sum && (sum_change < sum_lo || sum_change > sum_hi)) {
+    printf("FAIL: sum change not from %g%% to %g%%\n", sum_lo, sum_hi);
+    ok = false;
+  }
+  if (max_limit >= 0 && max_diff > max_limit) {
+    printf("FAIL: max diff above %g%%\n", max_limit);
+    ok = false;
+  }
+  if (mean_limit >= 0 && mean_diff > mean_limit) {
+    printf("FAIL: mean diff above %g%%\n", mean_limit);
+    ok = false;
+  }
+  if (frame_diff >= 0 && frames_pct > frame_limit) {
+    printf("FAIL: frames differing above %g%%\n", frame_limit);
+    ok = false;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# mono downmix (-M) compared with the mean of the bars of the two channels
+
+. "${srcdir:-.}/test_common.sh"
+
+$MAKE_INPUT -d 30 > "$tmp_dir/stereo.raw" || exit 99
+$MAKE_INPUT -d 30 -m > "$tmp_dir/mono.raw" || exit 99
+
+# fixed point mixes as (L + R) >> 1, the same as the mono input
+run -X -M -o "$tmp_dir/mix.txt" "$tmp_dir/stereo.raw"
+run -X -C 1 -o "$tmp_dir/ref.txt" "$tmp_dir/mono.raw"
+cmp "$tmp_dir/ref.txt" "$tmp_dir/mix.txt" || fail "-X -M differs from -X -C 1"
+
+for opts in "" "-n 0.8" "-b 30 -f 60"; do
+  # floating point mixes as (L + R) / 2, so within rounding of the mono input
+  run $opts -M -o "$tmp_dir/mix.txt" "$tmp_dir/stereo.raw"
+  run $opts -C 1 -o "$tmp_dir/ref.txt" "$tmp_dir/mono.raw"
+  compare -m 1 -s -0.1,0.1 "$tmp_dir/ref.txt" "$tmp_dir/mix.txt"
+
+  # the notes of the test signal differ in phase between the channels, and
+  # partly cancel in the mix, so the bars are lower than the mean of the
+  # bars of the channels, the bound documented in README.md
+  run $opts -o "$tmp_dir/ref.txt" "$tmp_dir/stereo.raw"
+  compare -s -30,-18 "$tmp_dir/ref.txt" "$tmp_dir/mix.txt"
+done
+
+exit 0
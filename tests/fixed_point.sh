@@ -0,0 +1,26 @@
+#!/bin/sh
+# fixed point (-X) compared with floating point with the exact rate (-E),
+# the bounds documented for SpectrumGenerator::set_fixed_point()
+
+. "${srcdir:-.}/test_common.sh"
+
+$MAKE_INPUT -d 30 > "$tmp_dir/stereo.raw" || exit 99
+$MAKE_INPUT -d 30 -m > "$tmp_dir/mono.raw" || exit 99
+
+for opts in "" "-S" "-b 30 -f 60" "-C 1" "-n 0.8" "-S -n 0.8" "-C 1 -n 0.8"
+do
+  case "$opts" in
+  *-C\ 1*) input="$tmp_dir/mono.raw" ;;
+  *) input="$tmp_dir/stereo.raw" ;;
+  esac
+  run $opts -E -o "$tmp_dir/ref.txt" "$input"
+  run $opts -X -o "$tmp_dir/fixed.txt" "$input"
+  case "$opts" in
+  # with gravity smoothing a small difference can start or stop the fall
+  # of a bar, so only a few frames may differ by more
+  *-n\ 0.8*) compare -a 1 -f 5,5 "$tmp_dir/ref.txt" "$tmp_dir/fixed.txt" ;;
+  *) compare -m 4 -a 0.5 -s 0,3 "$tmp_dir/ref.txt" "$tmp_dir/fixed.txt" ;;
+  esac
+done
+
+exit 0
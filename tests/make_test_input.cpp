@@ -0,0 +1,182 @@
+/*
+  Copyright (c) 2022, Adrian Rossiter
+
+  Antiprism - http://www.antiprism.com
+
+  Permission is hereby granted, free of charge, to any person obtaining a
+  copy of this software and associated documentation files (the "Software"),
+  to deal in the Software without restriction, including without limitation
+  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+  and/or sell copies of the Software, and to permit persons to whom the
+  Software is furnished to do so, subject to the following conditions:
+
+      The above copyright notice and this permission notice shall be included
+      in all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+  IN THE SOFTWARE.
+*/
+
+/* \file make_test_input.cpp
+   \brief write a fixed pcm_s16le test signal for the tests
+*/
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// linear congruential generator, so the signal is the same on every system
+class Random {
+private:
+  uint32_t state;
+
+public:
+  Random(uint32_t seed) : state(seed) {}
+
+  // a value from 0 to 1
+  double next()
+  {
+    state = state * 1664525u + 1013904223u;
+    return (state >> 8) / (double)(1u << 24);
+  }
+};
+
+// convert to a sample, clipped to the range
+int16_t to_sample(double val)
+{
+  const double gain = 0.3 * INT16_MAX; // the usual peak is about 1.5
+  return lround(std::fmax(-INT16_MAX, std::fmin(INT16_MAX, gain * val)));
+}
+
+struct Note {
+  double freq = 0.0;
+  double pan = 0.0;         // 0 left to 1 right
+  double phase_shift = 0.0; // phase of the right channel relative to left
+};
+
+void usage(const char *name)
+{
+  fprintf(stderr, R"(
+Usage: %s [options] > file.raw
+
+Write a test signal in pcm_s16le format to standard output. The signal is
+the same on every system, and has notes with harmonics that move between
+the channels and differ in phase, a kick drum, a hi-hat and background
+noise.
+
+  Options
+  -d <secs>  duration in seconds (default: 30)
+  -r <hz>    sample rate (default: 44100)
+  -m         write one channel, the mean of the left and right samples,
+             rounded down as (left + right) >> 1
+
+)",
+          name);
+}
+}; // namespace
+
+int main(int argc, char *argv[])
+{
+  double duration = 30.0;
+  int rate = 44100;
+  bool mono = false;
+
+  int c;
+  while ((c = getopt(argc, argv, "d:r:m")) != -1) {
+    switch (c) {
+    case 'd':
+      duration = atof(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'm':
+      mono = true;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind != argc || duration <= 0 || rate < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Random random(12345);
+  const size_t note_len = rate / 4; // in sample frames
+  const int scale[] = {0, 3, 5, 7, 10};
+  Note notes[2]; // the current note, and the previous note still sounding
+  const size_t num_frames = duration * rate;
+  std::vector<int16_t> buf;
+  buf.reserve(2 * rate);
+
+  for (size_t i = 0; i < num_frames; i++) {
+    const double t = (double)i / rate;
+    const double note_t = (double)(i % note_len) / rate;
+    if (i % note_len == 0) {
+      notes[1] = notes[0];
+      const int octave = random.next() * 3;
+      const int semitone = scale[(int)(random.next() * 5)] + 12 * octave;
+      notes[0].freq = 110.0 * pow(2.0, semitone / 12.0);
+      notes[0].pan = random.next();
+      notes[0].phase_shift = 2 * M_PI * random.next();
+    }
+
+    double left = 0.0;
+    double right = 0.0;
+    for (int n = 0; n < 2; n++) {
+      const Note &note = notes[n];
+      if (note.freq == 0.0)
+        continue;
+      const double note_time = note_t + n * (double)note_len / rate;
+      const double env = exp(-3.0 * note_time);
+      for (int h = 1; h <= 4; h++) {
+        const double phase = 2 * M_PI * note.freq * h * t;
+        left += env / h * (1 - note.pan) * sin(phase);
+        right += env / h * note.pan * sin(phase + note.phase_shift);
+      }
+    }
+
+    // kick drum every half second, the same in both channels
+    const double kick_t = fmod(t, 0.5);
+    const double kick =
+        0.8 * exp(-12.0 * kick_t) * sin(2 * M_PI * 55.0 * kick_t);
+    left += kick;
+    right += kick;
+
+    // hi-hat every eighth of a second, and background noise
+    const double hat_env = 0.3 * exp(-40.0 * fmod(t, 0.125)) + 0.01;
+    left += hat_env * (2 * random.next() - 1);
+    right += hat_env * (2 * random.next() - 1);
+
+    const int l = to_sample(left);
+    const int r = to_sample(right);
+    if (mono)
+      buf.push_back((l + r) >> 1);
+    else {
+      buf.push_back(l);
+      buf.push_back(r);
+    }
+
+    if (buf.size() >= 2 * (size_t)rate || i + 1 == num_frames) {
+      if (fwrite(buf.data(), sizeof(int16_t), buf.size(), stdout) !=
+          buf.size()) {
+        perror("make_test_input: writing output");
+        return 1;
+      }
+      buf.clear();
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,27 @@
+# common settings for the tests, sourced by each test script
+
+CAVA_FILTER=../src/cava_filter
+COMPARE=./compare_spectra
+MAKE_INPUT=./make_test_input
+
+tmp_dir=$(mktemp -d) || exit 99
+trap 'rm -rf "$tmp_dir"' EXIT
+
+fail()
+{
+  echo "FAIL: $*"
+  exit 1
+}
+
+# run cava_filter, stop the test if it fails
+run()
+{
+  echo "cava_filter $*"
+  $CAVA_FILTER "$@" || fail "cava_filter $*"
+}
+
+# compare outputs, the arguments are for compare_spectra
+compare()
+{
+  $COMPARE "$@" || fail "compare_spectra $*"
+}